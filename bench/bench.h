@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_BENCH_H
+#define CC_BENCH_H
+
+#include "src/allocationCounter.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+//
+// Minimal in-tree benchmark harness: runs a callable a fixed number of
+// times and reports the mean time per operation, the heap allocations per
+// operation and, when given, the throughput in items and bytes.
+// When one call processes several items, itemsPerCall turns the figures
+// into per item ones.
+//
+// Results are printed as a table, or as a single JSON document with --json
+// so that runs can be compared by scripts. RunLatency reports latency
+// percentiles rather than a mean only.
+//
+
+namespace Bench {
+
+struct Result {
+	std::string name;
+	uint64_t iterations;
+	double nsPerOp;
+	double allocsPerOp;
+	double itemsPerSecond;
+	double bytesPerSecond;	// 0 when not relevant
+	std::string note;	// Free form details, e.g. error counters
+};
+
+// Number of operator new calls since the start of the program (src/allocationCounter.h)
+inline uint64_t AllocationCount() { return CurrencyConverter::AllocationCount(); }
+
+// False when name does not match the --filter given on the command line
+bool Selected(const char *name);
+
+// Adds a result to the report
+void Record(const Result &result);
+
+// Informational message, kept out of the JSON output
+void Note(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Reports a check that failed: the program then exits with status 1
+void Fail(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Path of a file of bench/fixtures
+std::string FixturePath(const char *name);
+
+// Keeps the compiler from optimizing away a computed value
+template <typename T>
+inline void DoNotOptimize(const T &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename Fn>
+double Run(const char *name, uint64_t iterations, Fn fn, uint64_t itemsPerCall = 1, uint64_t bytesPerCall = 0)
+{
+	if (!Selected(name))
+		return 0;
+
+	// Warm up caches and branch predictors
+	for (uint64_t i = 0; i < iterations / 10; i++)
+		fn(i);
+
+	uint64_t allocations = AllocationCount();
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < iterations; i++)
+		fn(i);
+	auto end = std::chrono::steady_clock::now();
+	allocations = AllocationCount() - allocations;
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	double items = (double) iterations * itemsPerCall;
+
+	Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.nsPerOp = seconds * 1e9 / items;
+	result.allocsPerOp = allocations / items;
+	result.itemsPerSecond = items / seconds;
+	result.bytesPerSecond = (double) iterations * bytesPerCall / seconds;
+	Record(result);
+	return result.nsPerOp;
+}
+
+// Percentile p (0 < p <= 1) of sorted values, nearest rank
+inline double Percentile(const std::vector<double> &sorted, double p)
+{
+	size_t rank = (size_t) (p * sorted.size() + 0.999999);
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// Like Run, for operations whose latency varies, e.g. downloads: fn(i)
+// returns the latency of its operation in ns, as it measured it, or a
+// negative value when it went wrong. The mean excludes the errors, and
+// the note reports latency percentiles and the number of errors
+template <typename Fn>
+double RunLatency(const char *name, uint64_t iterations, Fn fn)
+{
+	if (!Selected(name))
+		return 0;
+
+	// Warm up: lazily loaded libraries, connections
+	fn(iterations);
+
+	std::vector<double> latencies;
+	latencies.reserve(iterations);
+	uint64_t errors = 0;
+	uint64_t allocations = AllocationCount();
+	for (uint64_t i = 0; i < iterations; i++) {
+		double ns = fn(i);
+		if (ns < 0)
+			errors++;
+		else
+			latencies.push_back(ns);
+	}
+	allocations = AllocationCount() - allocations;
+
+	double sum = 0;
+	for (size_t i = 0; i < latencies.size(); i++)
+		sum += latencies[i];
+	std::sort(latencies.begin(), latencies.end());
+
+	Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.nsPerOp = latencies.empty() ? 0 : sum / latencies.size();
+	result.allocsPerOp = (double) allocations / iterations;
+	result.itemsPerSecond = (sum > 0) ? latencies.size() * 1e9 / sum : 0;
+	result.bytesPerSecond = 0;
+
+	char note[160];
+	if (latencies.empty()) {
+		snprintf(note, sizeof(note), "errors %llu", (unsigned long long) errors);
+	} else {
+		snprintf(note, sizeof(note), "p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  max %.3f ms  errors %llu",
+			Percentile(latencies, 0.5) / 1e6, Percentile(latencies, 0.9) / 1e6,
+			Percentile(latencies, 0.99) / 1e6, latencies.back() / 1e6, (unsigned long long) errors);
+	}
+	result.note = note;
+	Record(result);
+	return result.nsPerOp;
+}
+
+} // namespace Bench
+
+#endif
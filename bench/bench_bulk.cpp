@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "src/convertKernels.h"
+#include "src/rateSnapshot.h"
+#include <math.h>
+#include <vector>
+
+using namespace CurrencyConverter;
+
+//
+// Bulk conversion kernels, scalar against the runtime selected SIMD ones.
+// Results of both implementations are compared before timing them.
+//
+
+static bool sameResults(const std::vector<double> &a, const std::vector<double> &b)
+{
+	for (size_t i = 0; i < a.size(); i++) {
+		if (fabs(a[i] - b[i]) > 1e-9 * fabs(a[i]))
+			return false;
+	}
+	return true;
+}
+
+void BenchBulk()
+{
+	static const size_t BATCH = 4096;
+	static const uint64_t ITERATIONS = 2000;
+
+	RateSnapshot snapshot;
+	for (CurrencyId id = 1; id < NUM_KNOWN_CURRENCIES; id++)
+		snapshot.SetRate(id, 0.5 + id * 0.37);
+	snapshot.BuildCrossRates();
+
+	std::vector<double> amounts(BATCH);
+	std::vector<CurrencyId> from(BATCH);
+	std::vector<CurrencyId> to(BATCH);
+	std::vector<double> scalarOut(BATCH);
+	std::vector<double> simdOut(BATCH);
+
+	for (size_t i = 0; i < BATCH; i++) {
+		// A few invalid elements to exercise the masking
+		amounts[i] = (i % 97 == 0) ? -1 : 1 + (i % 1000) * 0.25;
+		from[i] = (i % 89 == 0) ? INVALID_CURRENCY : i % NUM_KNOWN_CURRENCIES;
+		to[i] = (i * 7) % NUM_KNOWN_CURRENCIES;
+	}
+
+	double crossRate = snapshot.CrossRate(1, 8);
+
+	Kernels::UseScalar(true);
+	Kernels::MultiplyChecked(amounts.data(), crossRate, scalarOut.data(), BATCH);
+	Kernels::UseScalar(false);
+	Kernels::MultiplyChecked(amounts.data(), crossRate, simdOut.data(), BATCH);
+	if (!sameResults(scalarOut, simdOut))
+		Bench::Note("bulk/multiply: %s results differ from scalar ones!\n", Kernels::Implementation());
+
+	Kernels::UseScalar(true);
+	Kernels::GatherMultiply(amounts.data(), from.data(), to.data(), snapshot.CrossRates(), scalarOut.data(), BATCH);
+	Kernels::UseScalar(false);
+	Kernels::GatherMultiply(amounts.data(), from.data(), to.data(), snapshot.CrossRates(), simdOut.data(), BATCH);
+	if (!sameResults(scalarOut, simdOut))
+		Bench::Note("bulk/gather: %s results differ from scalar ones!\n", Kernels::Implementation());
+
+	Bench::Note("bulk kernels: %s\n", Kernels::Implementation());
+
+	Bench::Run("bulk/convert_by_id_loop", ITERATIONS, [&](uint64_t) {
+		for (size_t i = 0; i < BATCH; i++) {
+			double rate = snapshot.CrossRate(from[i], to[i]);
+			simdOut[i] = (rate < 0 || amounts[i] < 0) ? -1 : amounts[i] * rate;
+		}
+		Bench::DoNotOptimize(simdOut[0]);
+	}, BATCH);
+
+	Kernels::UseScalar(true);
+	Bench::Run("bulk/one_pair_scalar", ITERATIONS, [&](uint64_t) {
+		Kernels::MultiplyChecked(amounts.data(), crossRate, simdOut.data(), BATCH);
+		Bench::DoNotOptimize(simdOut[0]);
+	}, BATCH);
+	Bench::Run("bulk/per_element_pair_scalar", ITERATIONS, [&](uint64_t) {
+		Kernels::GatherMultiply(amounts.data(), from.data(), to.data(), snapshot.CrossRates(), simdOut.data(), BATCH);
+		Bench::DoNotOptimize(simdOut[0]);
+	}, BATCH);
+
+	Kernels::UseScalar(false);
+	Bench::Run("bulk/one_pair_simd", ITERATIONS, [&](uint64_t) {
+		Kernels::MultiplyChecked(amounts.data(), crossRate, simdOut.data(), BATCH);
+		Bench::DoNotOptimize(simdOut[0]);
+	}, BATCH);
+	Bench::Run("bulk/per_element_pair_simd", ITERATIONS, [&](uint64_t) {
+		Kernels::GatherMultiply(amounts.data(), from.data(), to.data(), snapshot.CrossRates(), simdOut.data(), BATCH);
+		Bench::DoNotOptimize(simdOut[0]);
+	}, BATCH);
+
+	// Exact minor units conversions, against the floating point ones
+	// followed by the rounding they need to give cents
+	const FixedRates &fixed = snapshot.Fixed();
+	std::vector<MinorUnits> minorAmounts(BATCH);
+	std::vector<MinorUnits> minorOut(BATCH);
+	for (size_t i = 0; i < BATCH; i++)
+		minorAmounts[i] = 100 + (i % 1000) * 25;
+
+	Bench::Run("bulk/one_pair_simd+round", ITERATIONS, [&](uint64_t) {
+		Kernels::MultiplyChecked(amounts.data(), crossRate, simdOut.data(), BATCH);
+		for (size_t i = 0; i < BATCH; i++)
+			minorOut[i] = llrint(simdOut[i] * 100);
+		Bench::DoNotOptimize(minorOut[0]);
+	}, BATCH);
+	Bench::Run("bulk/one_pair_fixed", ITERATIONS, [&](uint64_t) {
+		fixed.ConvertMany(minorAmounts.data(), minorOut.data(), BATCH, 1, 8);
+		Bench::DoNotOptimize(minorOut[0]);
+	}, BATCH);
+	Bench::Run("bulk/single_fixed", ITERATIONS * BATCH, [&](uint64_t i) {
+		MinorUnits out;
+		fixed.Convert(minorAmounts[i % BATCH], from[i % BATCH] % NUM_KNOWN_CURRENCIES, to[i % BATCH], &out);
+		Bench::DoNotOptimize(out);
+	});
+}
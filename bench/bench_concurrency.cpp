@@ -0,0 +1,247 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "src/rateManager.h"
+#include "src/snapshotPublisher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace CurrencyConverter;
+
+//
+// Snapshot publishing under concurrency.
+// Stress: readers check that every rate they get is internally
+// consistent while a writer keeps publishing new ones, through a bare
+// publisher and through a rates manager parsing ECB documents. Any
+// inconsistent read fails the run.
+// Scaling: conversion throughput from 1 to N reader threads.
+//
+
+// Generations the manager stress cycles through
+static const uint64_t NUM_DOCUMENTS = 8;
+
+static RateSnapshot *makeSnapshot(uint64_t generation)
+{
+	RateSnapshot *snapshot = new RateSnapshot();
+	for (CurrencyId id = 1; id < NUM_KNOWN_CURRENCIES; id++)
+		snapshot->SetRate(id, generation * 1000 + id);
+	snapshot->SetDate(generation);
+	snapshot->BuildCrossRates();
+	return snapshot;
+}
+
+// The ECB document of the rates of makeSnapshot
+static std::string makeDocument(uint64_t generation)
+{
+	std::string document = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<gesmes:Envelope xmlns:gesmes=\"http://www.gesmes.org/xml/2002-08-01\" "
+		"xmlns=\"http://www.ecb.int/vocabulary/2002-08-01/eurofxref\">\n"
+		"<Cube><Cube time='2024-11-29'>\n";
+	for (CurrencyId id = 1; id < NUM_KNOWN_CURRENCIES; id++) {
+		char cube[64];
+		snprintf(cube, sizeof(cube), "<Cube currency='%s' rate='%llu'/>\n", CurrencyCode(id),
+			(unsigned long long) (generation * 1000 + id));
+		document += cube;
+	}
+	document += "</Cube></Cube>\n</gesmes:Envelope>\n";
+	return document;
+}
+
+struct ReaderResult {
+	uint64_t conversions;
+	uint64_t errors;
+	char padding[48];
+};
+
+// read(from, to) converts, and returns false if the result is inconsistent
+template <typename Read>
+static void reader(Read read, const std::atomic<bool> &stop, ReaderResult *result)
+{
+	uint64_t conversions = 0, errors = 0;
+	unsigned seed = (unsigned) (uintptr_t) result;
+
+	while (!stop.load(std::memory_order_relaxed)) {
+		seed = seed * 1103515245 + 12345;
+		CurrencyId from = 1 + (seed >> 8) % (NUM_KNOWN_CURRENCIES - 1);
+		CurrencyId to = 1 + (seed >> 16) % (NUM_KNOWN_CURRENCIES - 1);
+
+		if (!read(from, to))
+			errors++;
+		conversions++;
+	}
+
+	result->conversions = conversions;
+	result->errors = errors;
+}
+
+// Readers run while publish(generation) is called for generations 2, 3...
+template <typename Read, typename Publish>
+static double runReaders(unsigned numReaders, std::chrono::milliseconds duration,
+	std::chrono::microseconds publishInterval, Read read, Publish publish,
+	uint64_t *errors, uint64_t *publications, uint64_t *totalConversions)
+{
+	std::atomic<bool> stop(false);
+	std::vector<ReaderResult> results(numReaders);
+	std::vector<std::thread> readers;
+	for (unsigned i = 0; i < numReaders; i++)
+		readers.push_back(std::thread(reader<Read>, read, std::cref(stop), &results[i]));
+
+	uint64_t generation = 1;
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + duration;
+	while (std::chrono::steady_clock::now() < end) {
+		publish(++generation);
+		std::this_thread::sleep_for(publishInterval);
+	}
+	stop.store(true);
+
+	for (size_t i = 0; i < readers.size(); i++)
+		readers[i].join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t conversions = 0;
+	*errors = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		conversions += results[i].conversions;
+		*errors += results[i].errors;
+	}
+	*publications = generation - 1;
+
+	*totalConversions = conversions;
+	return conversions / seconds;
+}
+
+static double runPublisherReaders(unsigned numReaders, std::chrono::milliseconds duration,
+	std::chrono::microseconds publishInterval, uint64_t *errors, uint64_t *publications, uint64_t *conversions)
+{
+	SnapshotPublisher publisher;
+	publisher.Publish(makeSnapshot(1));
+
+	auto read = [&publisher](CurrencyId from, CurrencyId to) {
+		SnapshotGuard rates(publisher);
+		double amount = 100.0 * rates->CrossRate(from, to);
+		Bench::DoNotOptimize(amount);
+		// Rates of one generation differ by their IDs only
+		return rates->Rate(to) - rates->Rate(from) == (double) to - from
+			&& amount == 100.0 * (rates->Rate(to) / rates->Rate(from));
+	};
+	auto publish = [&publisher](uint64_t generation) {
+		publisher.Publish(makeSnapshot(generation));
+	};
+	return runReaders(numReaders, duration, publishInterval, read, publish, errors, publications, conversions);
+}
+
+// Conversions through the public API while documents are parsed and
+// published: every result must be the one of a whole generation
+static double runManagerReaders(unsigned numReaders, std::chrono::milliseconds duration,
+	uint64_t *errors, uint64_t *publications, uint64_t *conversions)
+{
+	std::vector<std::string> documents;
+	std::vector<std::unique_ptr<RateSnapshot>> expected;
+	for (uint64_t generation = 1; generation <= NUM_DOCUMENTS; generation++) {
+		documents.push_back(makeDocument(generation));
+		expected.emplace_back(makeSnapshot(generation));
+	}
+
+	std::unique_ptr<RateManager> rr(new RateManager());
+	rr->ExtractRatesFromECBXml((void *) documents[0].data(), documents[0].size());
+
+	auto read = [&rr, &expected](CurrencyId from, CurrencyId to) {
+		double amount = rr->Convert(100.0, from, to);
+		Bench::DoNotOptimize(amount);
+		for (size_t i = 0; i < expected.size(); i++) {
+			if (amount == 100.0 * expected[i]->CrossRate(from, to))
+				return true;
+		}
+		return false;
+	};
+	auto publish = [&rr, &documents](uint64_t generation) {
+		std::string &document = documents[(generation - 1) % documents.size()];
+		rr->ExtractRatesFromECBXml((void *) document.data(), document.size());
+	};
+	return runReaders(numReaders, duration, std::chrono::microseconds(0), read, publish,
+		errors, publications, conversions);
+}
+
+// Runs are timed rather than counted: results are reported per conversion
+static void record(const char *name, double rate, uint64_t conversions, uint64_t allocations, const char *note)
+{
+	Bench::Result result;
+	result.name = name;
+	result.iterations = conversions;
+	result.nsPerOp = 1e9 / rate;
+	result.allocsPerOp = conversions ? (double) allocations / conversions : 0;
+	result.itemsPerSecond = rate;
+	result.bytesPerSecond = 0;
+	result.note = note;
+	Bench::Record(result);
+}
+
+static void recordStress(const char *name, double rate, uint64_t conversions, uint64_t allocations,
+	uint64_t publications, uint64_t errors)
+{
+	char note[96];
+	snprintf(note, sizeof(note), "%llu publications, %llu inconsistent reads",
+		(unsigned long long) publications, (unsigned long long) errors);
+	record(name, rate, conversions, allocations, note);
+	if (errors)
+		Bench::Fail("%s: %llu inconsistent reads", name, (unsigned long long) errors);
+}
+
+void BenchConcurrency()
+{
+	unsigned maxReaders = std::max(4u, std::thread::hardware_concurrency());
+	uint64_t errors, publications, conversions;
+
+	// Publishing as fast as possible maximizes reclamation races
+	if (Bench::Selected("concurrency/stress")) {
+		uint64_t allocations = Bench::AllocationCount();
+		double rate = runPublisherReaders(maxReaders, std::chrono::milliseconds(500), std::chrono::microseconds(0),
+			&errors, &publications, &conversions);
+		recordStress("concurrency/stress", rate, conversions, Bench::AllocationCount() - allocations,
+			publications, errors);
+	}
+
+	if (Bench::Selected("concurrency/manager_stress")) {
+		uint64_t allocations = Bench::AllocationCount();
+		double rate = runManagerReaders(maxReaders, std::chrono::milliseconds(500),
+			&errors, &publications, &conversions);
+		recordStress("concurrency/manager_stress", rate, conversions, Bench::AllocationCount() - allocations,
+			publications, errors);
+	}
+
+	for (unsigned readers = 1; readers <= maxReaders; readers *= 2) {
+		char name[64];
+		snprintf(name, sizeof(name), "concurrency/readers_%u", readers);
+		if (!Bench::Selected(name))
+			continue;
+		uint64_t allocations = Bench::AllocationCount();
+		double rate = runPublisherReaders(readers, std::chrono::milliseconds(300), std::chrono::microseconds(1000),
+			&errors, &publications, &conversions);
+		char note[32];
+		snprintf(note, sizeof(note), "%.2f Mconv/s", rate / 1e6);
+		record(name, rate, conversions, Bench::AllocationCount() - allocations, note);
+	}
+}
@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "ecb_stand_in.h"
+#include "src/ecbXmlParser.h"
+#include "src/rateManager.h"
+#include "src/rateSource.h"
+#include "src/utils.h"
+#include <chrono>
+#include <fstream>
+#include <math.h>
+#include <memory>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+//
+// The download path, from the request to usable rates, measured against a
+// local stand-in for the ECB website (ecb_stand_in.h) serving the
+// fixtures: plain loopback downloads, with the latency of a distant
+// server, over a throttled link, racing a slow mirror, failing over from
+// a failing one. Documents delivered in pieces down to a byte, splitting
+// every XML token, must parse to the rates of the fixture, and truncated
+// ones must be rejected.
+//
+
+static const char *const FETCH_BENCHES[] = {
+	"fetch/split_tokens", "fetch/truncated", "fetch/daily_loopback", "fetch/daily_not_modified",
+	"fetch/daily_latency_50ms", "fetch/daily_throttled_16k", "fetch/hist_90d_throttled_1m",
+	"fetch/race_slow_mirror", "fetch/failover_503",
+};
+
+static const unsigned FETCH_TIMEOUT_MS = 5000;
+
+static double elapsedNs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool sameRates(const RateSnapshot &a, const RateSnapshot &b)
+{
+	if (a.Date() != b.Date())
+		return false;
+	for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+		if (a.Rate(id) != b.Rate(id))
+			return false;
+	}
+	return true;
+}
+
+static bool sameHistories(const RateHistory &a, const RateHistory &b)
+{
+	if (a.NumDays() != b.NumDays() || !std::equal(a.Days(), a.Days() + a.NumDays(), b.Days()))
+		return false;
+	for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+		const double *columnA = a.Column(id), *columnB = b.Column(id);
+		if (!columnA != !columnB)
+			return false;
+		for (size_t i = 0; columnA && i < a.NumDays(); i++) {
+			if (columnA[i] != columnB[i] && !(isnan(columnA[i]) && isnan(columnB[i])))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Downloads a daily document from the first of urls that delivers one,
+// into rates. Returns the index of the winner, -1 if none delivered
+static int fetchRates(const std::vector<std::string> &urls, RateSnapshot &rates)
+{
+	RateSources sources;
+	std::vector<std::unique_ptr<RateSnapshot>> documents;
+	std::vector<std::unique_ptr<SnapshotXmlHandler>> handlers;
+	std::vector<std::unique_ptr<EcbXmlParser>> parsers;
+	std::vector<SourceFetch> fetches(urls.size());
+	for (size_t i = 0; i < urls.size(); i++) {
+		sources.emplace_back(new HttpRateSource(urls[i], FETCH_TIMEOUT_MS));
+		documents.emplace_back(new RateSnapshot());
+		handlers.emplace_back(new SnapshotXmlHandler(*documents.back()));
+		parsers.emplace_back(new EcbXmlParser(*handlers.back()));
+		fetches[i].parser = parsers.back().get();
+	}
+
+	int winner = FetchFirstDocument(sources, fetches.data(), NULL);
+	if (winner >= 0)
+		rates = *documents[winner];
+	return winner;
+}
+
+static int fetchHistory(const std::string &url, RateHistory &history)
+{
+	RateSources sources;
+	sources.emplace_back(new HttpRateSource(url, FETCH_TIMEOUT_MS));
+	history.Clear();
+	HistoryXmlHandler handler(history);
+	EcbXmlParser parser(handler);
+	SourceFetch fetch = {};
+	fetch.parser = &parser;
+	if (FetchFirstDocument(sources, &fetch, NULL) < 0)
+		return -1;
+	handler.Finish();
+	return 0;
+}
+
+void BenchFetch()
+{
+	bool selected = false;
+	for (size_t i = 0; i < sizeof(FETCH_BENCHES) / sizeof(FETCH_BENCHES[0]); i++)
+		selected = selected || Bench::Selected(FETCH_BENCHES[i]);
+	if (!selected)
+		return;
+
+	std::ifstream file(Bench::FixturePath("eurofxref-daily.xml").c_str(), std::ios::binary);
+	std::ostringstream content;
+	content << file.rdbuf();
+	std::string daily = content.str();
+
+	// Reference rates, parsed from the fixtures at once
+	RateSnapshot expected;
+	RateHistory expectedHistory;
+	{
+		SnapshotXmlHandler handler(expected);
+		EcbXmlParser parser(handler);
+		if (parser.Feed(daily.data(), daily.size()) < 0 || parser.Finish() < 0) {
+			Bench::Note("fetch: can't parse the fixtures of %s\n", Bench::FixturePath("").c_str());
+			return;
+		}
+	}
+	{
+		HistoryXmlHandler handler(expectedHistory);
+		EcbXmlParser parser(handler);
+		if (parser.FeedFile(Bench::FixturePath("eurofxref-hist-90d.xml")) < 0 || parser.Finish() < 0) {
+			Bench::Note("fetch: can't parse the fixtures of %s\n", Bench::FixturePath("").c_str());
+			return;
+		}
+		handler.Finish();
+	}
+
+	Bench::EcbStandIn standIn;
+	if (standIn.Start(Bench::FixturePath(""), 0) < 0) {
+		Bench::Note("fetch: can't start the ECB stand-in\n");
+		return;
+	}
+
+	// Rates managers keep their files in a directory of their own
+	char dir[] = "/tmp/ccbench.XXXXXX";
+	if (!mkdtemp(dir)) {
+		Bench::Note("fetch: can't create a temporary directory\n");
+		return;
+	}
+	const char *dataHome = getenv("XDG_DATA_HOME");
+	std::string previousDataHome = dataHome ? dataHome : "";
+	setenv("XDG_DATA_HOME", dir, 1);
+
+	// Every piece size up to a few tokens, with and without chunked
+	// transfer encoding: errors are documents parsed to other rates
+	static const unsigned PIECE_SIZES[] = { 1, 2, 3, 4, 5, 6, 7, 8, 11, 13, 17, 23, 31, 64, 127, 509 };
+	static const size_t NUM_PIECE_SIZES = sizeof(PIECE_SIZES) / sizeof(PIECE_SIZES[0]);
+	uint64_t writes = standIn.Writes();
+	Bench::RunLatency("fetch/split_tokens", 2 * NUM_PIECE_SIZES, [&](uint64_t i) {
+		char query[64];
+		snprintf(query, sizeof(query), "chunk=%u&gap=50&chunked=%d", PIECE_SIZES[i % NUM_PIECE_SIZES],
+			(int) ((i / NUM_PIECE_SIZES) & 1));
+		std::vector<std::string> urls(1, standIn.Url("eurofxref-daily.xml", query));
+		RateSnapshot rates;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int winner = fetchRates(urls, rates);
+		double ns = elapsedNs(start);
+
+		RateHistory history;
+		snprintf(query, sizeof(query), "chunk=%u&chunked=%d", PIECE_SIZES[i % NUM_PIECE_SIZES] * 13,
+			(int) ((i / NUM_PIECE_SIZES) & 1));
+		bool ok = winner == 0 && sameRates(rates, expected) &&
+			fetchHistory(standIn.Url("eurofxref-hist-90d.xml", query), history) == 0 &&
+			sameHistories(history, expectedHistory);
+		return ok ? ns : -1;
+	});
+	if (Bench::Selected("fetch/split_tokens"))
+		Bench::Note("fetch: documents delivered in %llu pieces\n", (unsigned long long) (standIn.Writes() - writes));
+
+	// Errors are truncated documents taken for whole ones
+	Bench::RunLatency("fetch/truncated", 2 * NUM_PIECE_SIZES, [&](uint64_t i) {
+		char query[64];
+		snprintf(query, sizeof(query), "truncate=%zu&chunked=%d",
+			daily.size() - PIECE_SIZES[i % NUM_PIECE_SIZES], (int) ((i / NUM_PIECE_SIZES) & 1));
+		std::vector<std::string> urls(1, standIn.Url("eurofxref-daily.xml", query));
+		RateSnapshot rates;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int winner = fetchRates(urls, rates);
+		return (winner < 0) ? elapsedNs(start) : -1;
+	});
+
+	// Fetch to usable rates, through a rates manager without cache: the
+	// download, parse, cache store and publication of the rates, until a
+	// conversion succeeds
+	std::string cacheFn = _getRateCacheFileName();
+	std::string validatorsFn = _getValidatorsFileName();
+	std::string leaseFn = _getRefreshLeaseFileName();
+	auto loadRates = [&](const std::string &url, bool keepCache) {
+		if (!keepCache) {
+			unlink(cacheFn.c_str());
+			unlink(validatorsFn.c_str());
+		}
+		std::unique_ptr<RateManager> rr(new RateManager());
+		rr->AddRateSource(url, FETCH_TIMEOUT_MS);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool ok = rr->LoadRates() == 0 && rr->Convert(1.0, CURRENCY_EUR, CurrencyIdFromCode("USD", 3)) > 0;
+		return ok ? elapsedNs(start) : -1;
+	};
+
+	Bench::RunLatency("fetch/daily_loopback", 200, [&](uint64_t) {
+		return loadRates(standIn.Url("eurofxref-daily.xml", ""), false);
+	});
+	// The fixture rates are outdated: cached, they are checked again, with
+	// the validators of the cached document. Errors are checks that were
+	// not answered 304 Not Modified
+	if (Bench::Selected("fetch/daily_not_modified"))
+		loadRates(standIn.Url("eurofxref-daily.xml", ""), false);
+	Bench::RunLatency("fetch/daily_not_modified", 200, [&](uint64_t) {
+		uint64_t notModified = standIn.NotModified();
+		double ns = loadRates(standIn.Url("eurofxref-daily.xml", ""), true);
+		return (standIn.NotModified() == notModified + 1) ? ns : -1;
+	});
+	Bench::RunLatency("fetch/daily_latency_50ms", 20, [&](uint64_t) {
+		return loadRates(standIn.Url("eurofxref-daily.xml", "latency=50"), false);
+	});
+	Bench::RunLatency("fetch/daily_throttled_16k", 10, [&](uint64_t) {
+		return loadRates(standIn.Url("eurofxref-daily.xml", "rate=16384"), false);
+	});
+
+	// Parsing overlaps the download: the history is usable right after its
+	// last byte arrives
+	Bench::RunLatency("fetch/hist_90d_throttled_1m", 10, [&](uint64_t) {
+		RateHistory history;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool ok = fetchHistory(standIn.Url("eurofxref-hist-90d.xml", "rate=1048576"), history) == 0;
+		return (ok && sameHistories(history, expectedHistory)) ? elapsedNs(start) : -1;
+	});
+
+	// Errors are downloads not won by the expected source
+	std::vector<std::string> race;
+	race.push_back(standIn.Url("eurofxref-daily.xml", "latency=300"));
+	race.push_back(standIn.Url("eurofxref-daily.xml", "latency=20"));
+	Bench::RunLatency("fetch/race_slow_mirror", 10, [&](uint64_t) {
+		RateSnapshot rates;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int winner = fetchRates(race, rates);
+		return (winner == 1 && sameRates(rates, expected)) ? elapsedNs(start) : -1;
+	});
+	std::vector<std::string> failover;
+	failover.push_back(standIn.Url("eurofxref-daily.xml", "status=503"));
+	failover.push_back(standIn.Url("eurofxref-daily.xml", "latency=20"));
+	Bench::RunLatency("fetch/failover_503", 10, [&](uint64_t) {
+		RateSnapshot rates;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int winner = fetchRates(failover, rates);
+		return (winner == 1 && sameRates(rates, expected)) ? elapsedNs(start) : -1;
+	});
+
+	standIn.Stop();
+	unlink(cacheFn.c_str());
+	unlink(validatorsFn.c_str());
+	unlink(leaseFn.c_str());
+	rmdir(dir);
+	if (dataHome)
+		setenv("XDG_DATA_HOME", previousDataHome.c_str(), 1);
+	else
+		unsetenv("XDG_DATA_HOME");
+}
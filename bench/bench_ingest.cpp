@@ -0,0 +1,272 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "src/ecbXmlParser.h"
+#include "src/rateArchive.h"
+#include "src/rateCache.h"
+#include "src/rateHistory.h"
+#include "src/rateManager.h"
+#include "src/utils.h"
+#include "src/windowAnalytics.h"
+#include <fstream>
+#include <math.h>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+//
+// Every stage between an ECB document and a conversion, measured offline
+// on the documents of bench/fixtures:
+//	eurofxref-daily.xml	one day, as downloaded by every refresh
+//	eurofxref-hist-90d.xml	64 business days
+// The full history (eurofxref-hist.xml, 25 years) is too large to be
+// checked in: a document of the same shape and size is generated from
+// the daily rates instead.
+//
+
+static const int HISTORY_DAYS = 6500;
+
+static std::string readFixture(const char *name)
+{
+	std::ifstream file(Bench::FixturePath(name).c_str(), std::ios::binary);
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+static std::string makeHistoryDocument(const RateSnapshot &rates, int lastDay, int numDays)
+{
+	std::string doc =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<gesmes:Envelope xmlns:gesmes=\"http://www.gesmes.org/xml/2002-08-01\""
+		" xmlns=\"http://www.ecb.int/vocabulary/2002-08-01/eurofxref\">\n"
+		"\t<gesmes:subject>Reference rates</gesmes:subject>\n"
+		"\t<gesmes:Sender>\n\t\t<gesmes:name>European Central Bank</gesmes:name>\n\t</gesmes:Sender>\n"
+		"\t<Cube>\n";
+
+	char line[64];
+	char date[ECB_DATE_LEN + 1];
+	for (int day = lastDay, k = 0; k < numDays; day--) {
+		// 1970-01-01 was a Thursday (Monday is 0): skip week-ends
+		int weekday = (day + 3) % 7;
+		if (weekday == 5 || weekday == 6)
+			continue;
+
+		dayToEcbDate(day, date);
+		snprintf(line, sizeof(line), "\t\t<Cube time='%s'>\n", date);
+		doc += line;
+		for (CurrencyId id = 1; id < NUM_KNOWN_CURRENCIES; id++) {
+			if (!rates.HasRate(id))
+				continue;
+			snprintf(line, sizeof(line), "\t\t\t<Cube currency='%s' rate='%.6g'/>\n",
+				CurrencyCode(id), rates.Rate(id) * (1 + 0.05 * sin(k * 0.01 + id)));
+			doc += line;
+		}
+		doc += "\t\t</Cube>\n";
+		k++;
+	}
+
+	doc += "\t</Cube>\n</gesmes:Envelope>\n";
+	return doc;
+}
+
+static int parseSnapshot(const std::string &doc, RateSnapshot &rates)
+{
+	SnapshotXmlHandler handler(rates);
+	EcbXmlParser parser(handler);
+	if (parser.Feed(doc.data(), doc.size()) < 0)
+		return -1;
+	return parser.Finish();
+}
+
+static int parseHistory(const std::string &doc, RateHistory &history)
+{
+	HistoryXmlHandler handler(history);
+	EcbXmlParser parser(handler);
+	if (parser.Feed(doc.data(), doc.size()) < 0 || parser.Finish() < 0)
+		return -1;
+	handler.Finish();
+	return 0;
+}
+
+static bool writeFile(const std::string &fileName, const std::string &content)
+{
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	file.write(content.data(), content.size());
+	return file.good();
+}
+
+void BenchIngest()
+{
+	std::string daily = readFixture("eurofxref-daily.xml");
+	std::string hist90d = readFixture("eurofxref-hist-90d.xml");
+
+	RateSnapshot rates;
+	RateHistory history;
+	if (parseSnapshot(daily, rates) < 0 || parseHistory(hist90d, history) < 0) {
+		Bench::Note("ingest: can't parse the fixtures of %s\n", Bench::FixturePath("").c_str());
+		return;
+	}
+	rates.BuildCrossRates();
+
+	std::string histFull = makeHistoryDocument(rates, history.LastDay(), HISTORY_DAYS);
+
+	char dir[] = "/tmp/ccbench.XXXXXX";
+	if (!mkdtemp(dir)) {
+		Bench::Note("ingest: can't create a temporary directory\n");
+		return;
+	}
+	std::string cacheFn = std::string(dir) + "/bench.rates";
+	std::string histFn = std::string(dir) + "/bench.hist";
+	std::string histXmlFn = std::string(dir) + "/eurofxref-hist.xml";
+	writeFile(histXmlFn, histFull);
+
+	Bench::Run("parse/daily", 20000, [&](uint64_t) {
+		RateSnapshot parsed;
+		Bench::DoNotOptimize(parseSnapshot(daily, parsed));
+	}, 1, daily.size());
+	Bench::Run("parse/hist_90d", 500, [&](uint64_t) {
+		RateHistory parsed;
+		Bench::DoNotOptimize(parseHistory(hist90d, parsed));
+	}, 1, hist90d.size());
+	Bench::Run("parse/hist_full", 5, [&](uint64_t) {
+		RateHistory parsed;
+		Bench::DoNotOptimize(parseHistory(histFull, parsed));
+	}, 1, histFull.size());
+
+	Bench::Run("snapshot/build_cross_rates", 20000, [&](uint64_t) {
+		rates.BuildCrossRates();
+		Bench::DoNotOptimize(rates.CrossRates());
+	});
+
+	// Quotes of another central bank, based on USD, for every currency ECB
+	// does not publish: best paths over the whole ID space
+	RateSnapshot quoted = rates;
+	std::vector<RateQuote> quotes;
+	CurrencyId usdId = CurrencyIdFromCode("USD", 3);
+	for (CurrencyId id = 1; id < MAX_CURRENCIES; id++) {
+		if (id != usdId && !rates.HasRate(id))
+			quotes.push_back(RateQuote{ usdId, id, 1.0 + id });
+	}
+	quoted.SetQuotes(quotes.data(), quotes.size());
+	Bench::Run("snapshot/build_cross_rates_quotes", 2000, [&](uint64_t) {
+		quoted.BuildCrossRates();
+		Bench::DoNotOptimize(quoted.CrossRates());
+	});
+
+	Bench::Run("cache/store", 2000, [&](uint64_t) {
+		Bench::DoNotOptimize(StoreRateCache(cacheFn, rates));
+	});
+	Bench::Run("cache/load", 20000, [&](uint64_t) {
+		RateSnapshot loaded;
+		Bench::DoNotOptimize(LoadRateCache(cacheFn, loaded));
+	});
+
+	Bench::Run("history/import_file", 5, [&](uint64_t) {
+		RateHistory imported;
+		Bench::DoNotOptimize(imported.ImportEcbXmlFile(histXmlFn));
+	}, 1, histFull.size());
+	parseHistory(histFull, history);
+	Bench::Run("history/store", 50, [&](uint64_t) {
+		Bench::DoNotOptimize(history.Store(histFn));
+	});
+	Bench::Run("history/load", 200, [&](uint64_t) {
+		RateHistory loaded;
+		Bench::DoNotOptimize(loaded.Load(histFn));
+	});
+	int firstDay = history.FirstDay();
+	int span = history.LastDay() - firstDay + 1;
+	Bench::Run("history/rate_as_of", 2000000, [&](uint64_t i) {
+		Bench::DoNotOptimize(history.Rate(1 + i % (NUM_KNOWN_CURRENCIES - 1), firstDay + (i * 7919) % span));
+	});
+
+	// Moving statistics over the whole history, for one pair and for every
+	// pair of the published currencies
+	WindowAnalytics analytics(history);
+	WindowStats stats;
+	CurrencyId usd = CurrencyIdFromCode("USD", 3), jpy = CurrencyIdFromCode("JPY", 3);
+	Bench::Run("history/window_stats", 200, [&](uint64_t) {
+		Bench::DoNotOptimize(analytics.Compute(usd, jpy, firstDay, history.LastDay(), 30, stats));
+	});
+	std::vector<CurrencyId> published;
+	for (CurrencyId id = 1; id < NUM_KNOWN_CURRENCIES; id++) {
+		if (history.Column(id))
+			published.push_back(id);
+	}
+	size_t numPairs = published.size() * (published.size() - 1) / 2;
+	Bench::Run("history/window_stats_all_pairs", 3, [&](uint64_t) {
+		for (size_t i = 0; i < published.size(); i++) {
+			for (size_t j = i + 1; j < published.size(); j++)
+				Bench::DoNotOptimize(analytics.Compute(published[i], published[j], firstDay, history.LastDay(), 30, stats));
+		}
+	}, numPairs);
+
+	// Archive of the whole history, rebuilt from scratch, then read back
+	// a year at a time (the last one) and whole
+	std::string archiveFn = std::string(dir) + "/bench.archive";
+	std::string pendingFn = archiveFn + ".pending";
+	Bench::Run("archive/append_history", 20, [&](uint64_t) {
+		unlink(archiveFn.c_str());
+		unlink(pendingFn.c_str());
+		RateArchive archive;
+		Bench::DoNotOptimize(archive.Open(archiveFn) == 0 && archive.Append(history) == 0);
+	}, history.NumDays());
+	RateArchive archive;
+	if (archive.Open(archiveFn) == 0 && !archive.Empty()) {
+		Bench::Note("archive: %zu days in %llu bytes (%zu blocks), %.0f bytes per year\n",
+			history.NumDays(), (unsigned long long) archive.Size(), archive.NumBlocks(),
+			archive.Size() * 365.25 / (archive.LastDay() - archive.FirstDay() + 1));
+	}
+	RateHistory archived;
+	Bench::Run("archive/load_year", 2000, [&](uint64_t) {
+		Bench::DoNotOptimize(archive.Load(history.LastDay() - 365, history.LastDay(), archived));
+	}, 1, archive.Size() * 365 / span);
+	Bench::Run("archive/load_all", 50, [&](uint64_t) {
+		Bench::DoNotOptimize(archive.Load(firstDay, history.LastDay(), archived));
+	}, 1, archive.Size());
+
+	// Public API: the daily document goes through the same path as a
+	// download, then conversions are served from the published snapshot
+	RateManager &rr = RateManager::Instance();
+	Bench::Run("manager/extract_daily", 20000, [&](uint64_t) {
+		rr.ExtractRatesFromECBXml((void *) daily.data(), daily.size());
+	}, 1, daily.size());
+
+	// Conversions must not fall back on the network when filtered alone
+	rr.ExtractRatesFromECBXml((void *) daily.data(), daily.size());
+
+	const std::string from = "USD", to = "JPY";
+	Bench::Run("manager/convert_by_code", 2000000, [&](uint64_t i) {
+		Bench::DoNotOptimize(rr.Convert(100.0 + (i & 0xFF), from, to));
+	});
+	CurrencyId fromId = CurrencyIdFromCode("USD", 3), toId = CurrencyIdFromCode("JPY", 3);
+	Bench::Run("manager/convert_by_id", 2000000, [&](uint64_t i) {
+		Bench::DoNotOptimize(rr.Convert(100.0 + (i & 0xFF), fromId, toId));
+	});
+
+	unlink(cacheFn.c_str());
+	unlink(histFn.c_str());
+	unlink(histXmlFn.c_str());
+	unlink(archiveFn.c_str());
+	unlink(pendingFn.c_str());
+	rmdir(dir);
+}
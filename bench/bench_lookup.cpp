@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "src/currency.h"
+#include "src/ecbCalendar.h"
+#include "src/rateSnapshot.h"
+#include <exception>
+#include <map>
+#include <string>
+
+using namespace CurrencyConverter;
+
+//
+// Compares the former std::map based rate lookup (two string keyed tree
+// walks, EUR special case, exception on miss) with the interned ID lookup
+// through the precomputed cross rates matrix. Also times the TARGET
+// calendar lookup of freshness checks.
+//
+
+static const struct {
+	const char *code;
+	double rate;
+} SAMPLE_RATES[] = {
+	{ "USD", 1.0823 }, { "JPY", 162.45 }, { "BGN", 1.9558 }, { "CZK", 25.301 },
+	{ "DKK", 7.4605 }, { "GBP", 0.85533 }, { "HUF", 390.73 }, { "PLN", 4.3183 },
+	{ "RON", 4.9688 }, { "SEK", 11.2675 }, { "CHF", 0.9778 }, { "ISK", 149.90 },
+	{ "NOK", 11.6125 }, { "TRY", 34.9117 }, { "AUD", 1.6313 }, { "BRL", 5.4453 },
+	{ "CAD", 1.4684 }, { "CNY", 7.7767 }, { "HKD", 8.4603 }, { "IDR", 16995.26 },
+	{ "ILS", 4.0197 }, { "INR", 90.4795 }, { "KRW", 1432.05 }, { "MXN", 18.0927 },
+	{ "MYR", 5.1203 }, { "NZD", 1.7945 }, { "PHP", 60.635 }, { "SGD", 1.4560 },
+	{ "THB", 39.482 }, { "ZAR", 20.2311 },
+};
+static const size_t NUM_SAMPLE_RATES = sizeof(SAMPLE_RATES) / sizeof(SAMPLE_RATES[0]);
+
+typedef std::map <std::string, double> LegacyRatesTable;
+
+static double legacyCurrencyToRate(const LegacyRatesTable &rates, const std::string &currency)
+{
+	if (currency == "EUR")
+		return 1;
+
+	try {
+		return rates.at(currency);
+	} catch (std::exception &e) {
+		return -1;
+	}
+}
+
+static double legacyConvert(const LegacyRatesTable &rates, double amount, const std::string &from, const std::string &to)
+{
+	double toRate = legacyCurrencyToRate(rates, to);
+	double fromRate = legacyCurrencyToRate(rates, from);
+	if (toRate < 0 || fromRate < 0)
+		return -1;
+
+	return amount * toRate / fromRate;
+}
+
+void BenchLookup()
+{
+	static const uint64_t ITERATIONS = 2000000;
+
+	LegacyRatesTable legacy;
+	RateSnapshot snapshot;
+	std::string codes[NUM_SAMPLE_RATES + 1];
+	CurrencyId ids[NUM_SAMPLE_RATES + 1];
+
+	for (size_t i = 0; i < NUM_SAMPLE_RATES; i++) {
+		legacy.insert(std::make_pair(SAMPLE_RATES[i].code, SAMPLE_RATES[i].rate));
+		snapshot.SetRate(CurrencyIdFromCode(SAMPLE_RATES[i].code, 3), SAMPLE_RATES[i].rate);
+		codes[i] = SAMPLE_RATES[i].code;
+		ids[i] = CurrencyIdFromCode(SAMPLE_RATES[i].code, 3);
+	}
+	codes[NUM_SAMPLE_RATES] = "EUR";
+	ids[NUM_SAMPLE_RATES] = CURRENCY_EUR;
+	snapshot.BuildCrossRates();
+
+	const size_t n = NUM_SAMPLE_RATES + 1;
+	std::string unknown = "XXX";
+
+	Bench::Run("lookup/legacy_map", ITERATIONS, [&](uint64_t i) {
+		Bench::DoNotOptimize(legacyConvert(legacy, 100.0, codes[i % n], codes[(i * 7) % n]));
+	});
+	Bench::Run("lookup/legacy_map_miss", ITERATIONS / 10, [&](uint64_t i) {
+		Bench::DoNotOptimize(legacyConvert(legacy, 100.0, codes[i % n], unknown));
+	});
+	Bench::Run("lookup/id_from_code+matrix", ITERATIONS, [&](uint64_t i) {
+		const std::string &from = codes[i % n];
+		const std::string &to = codes[(i * 7) % n];
+		CurrencyId fromId = CurrencyIdFromCode(from.c_str(), from.size());
+		CurrencyId toId = CurrencyIdFromCode(to.c_str(), to.size());
+		Bench::DoNotOptimize(100.0 * snapshot.CrossRate(fromId, toId));
+	});
+	Bench::Run("lookup/id_from_code+matrix_miss", ITERATIONS, [&](uint64_t i) {
+		const std::string &from = codes[i % n];
+		CurrencyId fromId = CurrencyIdFromCode(from.c_str(), from.size());
+		CurrencyId toId = CurrencyIdFromCode(unknown.c_str(), unknown.size());
+		Bench::DoNotOptimize(100.0 * snapshot.CrossRate(fromId, toId));
+	});
+	Bench::Run("lookup/matrix_by_id", ITERATIONS, [&](uint64_t i) {
+		Bench::DoNotOptimize(100.0 * snapshot.CrossRate(ids[i % n], ids[(i * 7) % n]));
+	});
+
+	// Freshness check: the expected last publication, from the precomputed
+	// TARGET calendar, at times spread over ten years
+	time_t start = (time_t) CivilToDay(2020, 1, 1) * 86400;
+	Bench::Run("lookup/last_publication_time", ITERATIONS, [&](uint64_t i) {
+		Bench::DoNotOptimize(LastPublicationTime(start + (time_t) (i % 100000) * 3163));
+	});
+}
@@ -0,0 +1,194 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "ecb_stand_in.h"
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef CC_BENCH_FIXTURES_DIR
+#define CC_BENCH_FIXTURES_DIR "bench/fixtures"
+#endif
+
+void BenchLookup();
+void BenchBulk();
+void BenchIngest();
+void BenchConcurrency();
+void BenchStartup();
+void BenchFetch();
+
+static const struct {
+	const char *name;
+	void (*run)();
+} GROUPS[] = {
+	{ "lookup", BenchLookup },
+	{ "bulk", BenchBulk },
+	{ "ingest", BenchIngest },
+	{ "concurrency", BenchConcurrency },
+	{ "startup", BenchStartup },
+	{ "fetch", BenchFetch },
+};
+
+static std::vector<Bench::Result> results;
+static const char *filter = NULL;
+static bool json = false;
+static bool failed = false;
+
+bool Bench::Selected(const char *name)
+{
+	return !filter || strstr(name, filter);
+}
+
+void Bench::Record(const Result &result)
+{
+	results.push_back(result);
+	if (json)
+		return;
+
+	printf("%-40s %12.2f ns/op %8.2f allocs/op", result.name.c_str(), result.nsPerOp, result.allocsPerOp);
+	if (result.bytesPerSecond > 0)
+		printf(" %10.2f MB/s", result.bytesPerSecond / 1e6);
+	if (!result.note.empty())
+		printf("  %s", result.note.c_str());
+	printf("\n");
+}
+
+void Bench::Note(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(json ? stderr : stdout, format, args);
+	va_end(args);
+}
+
+void Bench::Fail(const char *format, ...)
+{
+	failed = true;
+	fprintf(stderr, "FAILED: ");
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+}
+
+std::string Bench::FixturePath(const char *name)
+{
+	return std::string(CC_BENCH_FIXTURES_DIR) + "/" + name;
+}
+
+static void printJsonString(const std::string &s)
+{
+	putchar('"');
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			putchar('\\');
+		putchar(s[i]);
+	}
+	putchar('"');
+}
+
+static void printJson()
+{
+	printf("{\n\t\"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const Bench::Result &r = results[i];
+		printf("\t\t{ \"name\": ");
+		printJsonString(r.name);
+		printf(", \"iterations\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f"
+			", \"items_per_second\": %.1f, \"bytes_per_second\": %.1f",
+			(unsigned long long) r.iterations, r.nsPerOp, r.allocsPerOp,
+			r.itemsPerSecond, r.bytesPerSecond);
+		if (!r.note.empty()) {
+			printf(", \"note\": ");
+			printJsonString(r.note);
+		}
+		printf(" }%s\n", (i + 1 < results.size()) ? "," : "");
+	}
+	printf("\t]\n}\n");
+}
+
+static void usage()
+{
+	printf("Usage: currencyconverter_bench [--json] [--filter SUBSTRING]\n");
+	printf("       currencyconverter_bench --serve PORT\n");
+	printf("\t--json\t\tprint results as a JSON document\n");
+	printf("\t--filter\tonly run benchmarks whose name contains SUBSTRING\n");
+	printf("\t--serve\t\tserve the fixtures on 127.0.0.1:PORT like ECB, until\n");
+	printf("\t\t\tinterrupted (see bench/ecb_stand_in.h)\n");
+	printf("Groups:");
+	for (size_t i = 0; i < sizeof(GROUPS) / sizeof(GROUPS[0]); i++)
+		printf(" %s", GROUPS[i].name);
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option longOptions[] = {
+		{ "json", no_argument, NULL, 'j' },
+		{ "filter", required_argument, NULL, 'f' },
+		{ "serve", required_argument, NULL, 's' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int opt;
+	int servePort = -1;
+	while ((opt = getopt_long(argc, argv, "jf:s:h", longOptions, NULL)) != -1) {
+		switch (opt) {
+		case 'j':
+			json = true;
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 's':
+			servePort = atoi(optarg);
+			break;
+		default:
+			usage();
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	// The ECB stand-in alone, e.g. for
+	//	currencyconverter --source 'http://127.0.0.1:PORT/eurofxref-daily.xml?latency=200'
+	if (servePort >= 0) {
+		Bench::EcbStandIn standIn;
+		if (standIn.Start(Bench::FixturePath(""), servePort) < 0) {
+			fprintf(stderr, "Can't listen on port %d\n", servePort);
+			return 1;
+		}
+		printf("Serving %s on %s\n", Bench::FixturePath("").c_str(), standIn.Url("", "").c_str());
+		fflush(stdout);
+		for (;;)
+			pause();
+	}
+
+	for (size_t i = 0; i < sizeof(GROUPS) / sizeof(GROUPS[0]); i++)
+		GROUPS[i].run();
+
+	if (json)
+		printJson();
+	return failed ? 1 : 0;
+}
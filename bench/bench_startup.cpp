@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "src/ecbXmlParser.h"
+#include "src/rateCache.h"
+#include <fcntl.h>
+#include <fstream>
+#include <spawn.h>
+#include <sstream>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+//
+// Cold start: a whole currencyconverter process, from exec to exit, with
+// a fresh rates cache. Set CC_BENCH_CLI to time another build of the tool.
+//
+
+#ifndef CC_BENCH_CLI_PATH
+#define CC_BENCH_CLI_PATH "currencyconverter"
+#endif
+
+static int runCli(const char *cli, char *const *argv, char *const *envp)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+	pid_t pid;
+	int status = -1;
+	if (posix_spawn(&pid, cli, &actions, NULL, argv, envp) == 0)
+		waitpid(pid, &status, 0);
+
+	posix_spawn_file_actions_destroy(&actions);
+	return status;
+}
+
+void BenchStartup()
+{
+	static const uint64_t ITERATIONS = 200;
+
+	if (!Bench::Selected("startup/version") && !Bench::Selected("startup/convert_fresh_cache"))
+		return;
+
+	const char *cli = getenv("CC_BENCH_CLI");
+	if (!cli)
+		cli = CC_BENCH_CLI_PATH;
+
+	// Fresh cache: the daily fixture, dated now
+	std::ifstream file(Bench::FixturePath("eurofxref-daily.xml").c_str(), std::ios::binary);
+	std::ostringstream daily;
+	daily << file.rdbuf();
+	std::string doc = daily.str();
+
+	RateSnapshot rates;
+	SnapshotXmlHandler handler(rates);
+	EcbXmlParser parser(handler);
+	if (parser.Feed(doc.data(), doc.size()) < 0 || parser.Finish() < 0) {
+		Bench::Note("startup: can't parse the daily fixture\n");
+		return;
+	}
+	rates.SetDate(time(NULL));
+
+	char dir[] = "/tmp/ccbench.XXXXXX";
+	if (!mkdtemp(dir)) {
+		Bench::Note("startup: can't create a temporary directory\n");
+		return;
+	}
+	std::string cacheFn = std::string(dir) + "/currency_converter.rates";
+	StoreRateCache(cacheFn, rates);
+
+	std::string dataHome = std::string("XDG_DATA_HOME=") + dir;
+	char *envp[] = { (char *) dataHome.c_str(), NULL };
+	char *convertArgv[] = { (char *) "currencyconverter", (char *) "-a", (char *) "100",
+		(char *) "-f", (char *) "USD", (char *) "-t", (char *) "JPY", NULL };
+	char *versionArgv[] = { (char *) "currencyconverter", (char *) "-v", NULL };
+
+	if (runCli(cli, convertArgv, envp) != 0) {
+		Bench::Note("startup: %s failed\n", cli);
+	} else {
+		Bench::Run("startup/version", ITERATIONS, [&](uint64_t) {
+			runCli(cli, versionArgv, envp);
+		});
+		Bench::Run("startup/convert_fresh_cache", ITERATIONS, [&](uint64_t) {
+			runCli(cli, convertArgv, envp);
+		});
+	}
+
+	unlink(cacheFn.c_str());
+	rmdir(dir);
+}
@@ -0,0 +1,329 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ecb_stand_in.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace Bench;
+
+static const size_t MAX_REQUEST_SIZE = 8192;
+static const uint64_t THROTTLE_PIECES_PER_SECOND = 100;
+
+// How a request wants to be answered (see EcbStandIn)
+struct Behavior {
+	unsigned long latencyMs;
+	unsigned long bytesPerSecond;
+	unsigned long chunkSize;
+	unsigned long gapUs;
+	bool chunked;
+	unsigned long status;
+	long truncateAt;	// -1: whole body
+};
+
+static Behavior _parseQuery(const std::string &query)
+{
+	Behavior behavior = { 0, 0, 0, 0, false, 0, -1 };
+
+	std::istringstream params(query);
+	std::string param;
+	while (std::getline(params, param, '&')) {
+		size_t eq = param.find('=');
+		if (eq == std::string::npos)
+			continue;
+		std::string name = param.substr(0, eq);
+		unsigned long value = strtoul(param.c_str() + eq + 1, NULL, 10);
+
+		if (name == "latency")
+			behavior.latencyMs = value;
+		else if (name == "rate")
+			behavior.bytesPerSecond = value;
+		else if (name == "chunk")
+			behavior.chunkSize = value;
+		else if (name == "gap")
+			behavior.gapUs = value;
+		else if (name == "chunked")
+			behavior.chunked = value != 0;
+		else if (name == "status")
+			behavior.status = value;
+		else if (name == "truncate")
+			behavior.truncateAt = value;
+	}
+	return behavior;
+}
+
+static bool _sendAll(int fd, const char *data, size_t len)
+{
+	while (len > 0) {
+		// The client may have given up: no SIGPIPE
+		ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool _sendStatus(int fd, unsigned long status, const char *reason, const std::string &headers)
+{
+	char line[128];
+	snprintf(line, sizeof(line), "HTTP/1.1 %lu %s\r\n", status, reason);
+	std::string response = line + headers + "Content-Length: 0\r\nConnection: close\r\n\r\n";
+	return _sendAll(fd, response.data(), response.size());
+}
+
+// Value of a request header, empty if absent
+static std::string _headerValue(const std::string &request, const char *name)
+{
+	size_t nameLen = strlen(name);
+	for (size_t line = request.find("\r\n"); line != std::string::npos; line = request.find("\r\n", line + 2)) {
+		const char *start = request.c_str() + line + 2;
+		if (strncasecmp(start, name, nameLen) || start[nameLen] != ':')
+			continue;
+
+		size_t begin = line + 2 + nameLen + 1;
+		size_t end = request.find("\r\n", begin);
+		while (begin < end && request[begin] == ' ')
+			begin++;
+		return request.substr(begin, end - begin);
+	}
+	return std::string();
+}
+
+// Writes the response of a document as asked, counting the body writes
+static void _serveDocument(int fd, const std::string &body, const std::string &validators,
+	const Behavior &behavior, std::atomic<uint64_t> &writes)
+{
+	std::string headers = "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\n" + validators;
+	if (behavior.chunked)
+		headers += "Transfer-Encoding: chunked\r\n";
+	else
+		headers += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+	headers += "Connection: close\r\n\r\n";
+	if (!_sendAll(fd, headers.data(), headers.size()))
+		return;
+
+	// Pieces must leave as they are written, not coalesced
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	size_t length = body.size();
+	if (behavior.truncateAt >= 0 && (size_t) behavior.truncateAt < length)
+		length = behavior.truncateAt;
+	size_t piece = behavior.chunkSize;
+	if (!piece && behavior.bytesPerSecond)
+		piece = std::max<size_t>(1, behavior.bytesPerSecond / THROTTLE_PIECES_PER_SECOND);
+	if (!piece)
+		piece = std::max<size_t>(1, length);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t sent = 0; sent < length; ) {
+		size_t len = std::min(piece, length - sent);
+		writes++;
+		bool ok;
+		if (behavior.chunked) {
+			char size[32];
+			snprintf(size, sizeof(size), "%zx\r\n", len);
+			std::string framed = size + body.substr(sent, len) + "\r\n";
+			ok = _sendAll(fd, framed.data(), framed.size());
+		} else {
+			ok = _sendAll(fd, body.data() + sent, len);
+		}
+		if (!ok)
+			return;
+		sent += len;
+
+		if (sent == length)
+			break;
+		if (behavior.bytesPerSecond)
+			std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 1000000 / behavior.bytesPerSecond));
+		else if (behavior.gapUs)
+			std::this_thread::sleep_for(std::chrono::microseconds(behavior.gapUs));
+	}
+
+	// A truncated body is not terminated either way
+	if (behavior.chunked && length == body.size())
+		_sendAll(fd, "0\r\n\r\n", 5);
+}
+
+EcbStandIn::EcbStandIn() :
+	m_listenFd(-1),
+	m_port(0),
+	m_stopping(false),
+	m_requests(0),
+	m_writes(0),
+	m_notModified(0),
+	m_connections(0)
+{
+}
+
+EcbStandIn::~EcbStandIn()
+{
+	Stop();
+}
+
+int EcbStandIn::Start(const std::string &dir, uint16_t port)
+{
+	m_dir = dir;
+	m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_listenFd < 0)
+		return -1;
+
+	int on = 1;
+	setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	socklen_t addrLen = sizeof(addr);
+	if (bind(m_listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(m_listenFd, 64) < 0 ||
+		getsockname(m_listenFd, (struct sockaddr *) &addr, &addrLen) < 0) {
+		close(m_listenFd);
+		m_listenFd = -1;
+		return -1;
+	}
+	m_port = ntohs(addr.sin_port);
+
+	m_stopping = false;
+	m_acceptThread = std::thread(&EcbStandIn::acceptConnections, this);
+	return 0;
+}
+
+void EcbStandIn::Stop()
+{
+	if (m_listenFd < 0)
+		return;
+
+	// Wakes up accept()
+	m_stopping = true;
+	shutdown(m_listenFd, SHUT_RDWR);
+	m_acceptThread.join();
+	close(m_listenFd);
+	m_listenFd = -1;
+
+	std::unique_lock<std::mutex> lock(m_connectionsLock);
+	m_idle.wait(lock, [this]() { return m_connections == 0; });
+}
+
+std::string EcbStandIn::Url(const char *document, const char *query) const
+{
+	char url[64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/", m_port);
+	std::string result = std::string(url) + document;
+	if (query && *query)
+		result += std::string("?") + query;
+	return result;
+}
+
+void EcbStandIn::acceptConnections()
+{
+	while (!m_stopping) {
+		int fd = accept4(m_listenFd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		// A thread per connection: responses may take their time
+		std::lock_guard<std::mutex> lock(m_connectionsLock);
+		m_connections++;
+		std::thread(&EcbStandIn::serve, this, fd).detach();
+	}
+}
+
+void EcbStandIn::serve(int fd)
+{
+	std::string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		request.append(buffer, n);
+	}
+
+	// "GET /<document>?<query> HTTP/1.1"
+	size_t targetStart = request.find(' ');
+	size_t targetEnd = (targetStart == std::string::npos) ? targetStart : request.find(' ', targetStart + 1);
+	if (targetEnd != std::string::npos && request.compare(0, targetStart, "GET") == 0) {
+		m_requests++;
+		std::string target = request.substr(targetStart + 1, targetEnd - targetStart - 1);
+		size_t queryStart = target.find('?');
+		std::string document = target.substr(1, queryStart == std::string::npos ? std::string::npos : queryStart - 1);
+		Behavior behavior = _parseQuery(queryStart == std::string::npos ? "" : target.substr(queryStart + 1));
+
+		if (behavior.latencyMs)
+			std::this_thread::sleep_for(std::chrono::milliseconds(behavior.latencyMs));
+
+		std::string fileName = m_dir + "/" + document;
+		std::ifstream file(fileName.c_str(), std::ios::binary);
+		struct stat st;
+		if (behavior.status) {
+			_sendStatus(fd, behavior.status, "Stand-in status", "");
+		} else if (document.empty() || document.find('/') != std::string::npos || !file ||
+			stat(fileName.c_str(), &st) < 0) {
+			_sendStatus(fd, 404, "Not Found", "");
+		} else {
+			char etag[64];
+			char lastModified[64];
+			struct tm tm;
+			snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long) st.st_size,
+				(unsigned long long) st.st_mtime);
+			strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&st.st_mtime, &tm));
+			std::string validators = std::string("ETag: ") + etag + "\r\nLast-Modified: " + lastModified + "\r\n";
+
+			if (_headerValue(request, "If-None-Match") == etag) {
+				// Counted first: the client may check as soon as it is answered
+				m_notModified++;
+				_sendStatus(fd, 304, "Not Modified", validators);
+			} else {
+				std::ostringstream content;
+				content << file.rdbuf();
+				_serveDocument(fd, content.str(), validators, behavior, m_writes);
+			}
+		}
+	}
+
+	close(fd);
+
+	std::lock_guard<std::mutex> lock(m_connectionsLock);
+	if (--m_connections == 0)
+		m_idle.notify_all();
+}
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_BENCH_ECB_STAND_IN_H
+#define CC_BENCH_ECB_STAND_IN_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+namespace Bench {
+
+//
+// Local stand-in for the ECB website: a minimal HTTP/1.1 server on
+// 127.0.0.1, serving the files of a directory (the fixtures), so that the
+// download path can be exercised and profiled offline.
+//
+// Each request says how it wants to be answered, in its query string, so
+// that one server can play a fast mirror and a failing one at once:
+//	latency=<ms>	wait before answering
+//	rate=<bytes/s>	throttle the body, written in 10 ms pieces
+//	chunk=<bytes>	write the body in pieces of that size...
+//	gap=<us>	...separated by that long, unless throttled
+//	chunked=1	with Transfer-Encoding: chunked, a chunk per piece
+//	status=<code>	answer with that status and no document
+//	truncate=<bytes>	close the connection after that much body
+// e.g. /eurofxref-daily.xml?latency=200&chunk=7&gap=100
+//
+// Documents carry an ETag, and If-None-Match gets 304 Not Modified, as
+// from ECB. Connections are closed after each response.
+//
+class EcbStandIn {
+public:
+	EcbStandIn();
+	~EcbStandIn();
+
+	// Serves the files of dir on port, any free one if 0. Returns -1 if
+	// the port can't be bound
+	int Start(const std::string &dir, uint16_t port);
+	// Waits for the responses in progress
+	void Stop();
+
+	uint16_t Port() const { return m_port; }
+	// URL of a document of the directory, query without the '?'
+	std::string Url(const char *document, const char *query) const;
+	// Requests answered so far, and body writes: with chunk, how many
+	// pieces the documents were actually split in
+	uint64_t Requests() const { return m_requests; }
+	uint64_t Writes() const { return m_writes; }
+	uint64_t NotModified() const { return m_notModified; }
+
+private:
+	EcbStandIn(const EcbStandIn &);
+	EcbStandIn& operator=(const EcbStandIn &);
+
+	void acceptConnections();
+	void serve(int fd);
+
+	std::string m_dir;
+	int m_listenFd;
+	uint16_t m_port;
+	std::atomic<bool> m_stopping;
+	std::atomic<uint64_t> m_requests;
+	std::atomic<uint64_t> m_writes;
+	std::atomic<uint64_t> m_notModified;
+	std::thread m_acceptThread;
+	std::mutex m_connectionsLock;
+	std::condition_variable m_idle;
+	unsigned m_connections;		// Being served, under m_connectionsLock
+};
+
+} // namespace Bench
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "allocationCounter.h"
+#include "metrics.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> _allocationCount(0);
+
+uint64_t CurrencyConverter::AllocationCount()
+{
+    return _allocationCount.load(std::memory_order_relaxed);
+}
+
+// Reported with the metrics
+static struct AllocationCounterRegistration {
+    AllocationCounterRegistration() { CurrencyConverter::Metrics::SetAllocationCounter(CurrencyConverter::AllocationCount); }
+} _registration;
+
+void *operator new(size_t size)
+{
+    _allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    _allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_ALLOCATION_COUNTER_H
+#define CC_ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+namespace CurrencyConverter {
+
+//
+// Heap allocation accounting, to check that the steady state paths
+// (rates ingestion, conversions) don't allocate.
+// allocationCounter.cpp replaces the global operator new to count its
+// calls: it is linked in the benchmarks, and in the command line tool when
+// built with COUNT_ALLOCATIONS (default in Debug builds), where --stats
+// then reports the count. Allocations made by C libraries (libxml2,
+// libcurl) through malloc are not seen.
+//
+
+// Number of operator new calls since the start of the program
+uint64_t AllocationCount();
+
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "convertKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CC_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace CurrencyConverter;
+
+namespace {
+
+typedef void (*MultiplyCheckedFn)(const double *, double, double *, size_t);
+typedef void (*GatherMultiplyFn)(const double *, const CurrencyId *, const CurrencyId *,
+    const double *, double *, size_t);
+typedef void (*BinaryFn)(const double *, const double *, double *, size_t);
+typedef void (*WindowSumsFn)(const double *, size_t, double, double *, size_t);
+
+struct KernelSet {
+    const char *name;
+    MultiplyCheckedFn multiplyChecked;
+    GatherMultiplyFn gatherMultiply;
+    BinaryFn divide;
+    BinaryFn subtract;
+    BinaryFn maximum;
+    BinaryFn minimum;
+    WindowSumsFn windowSums;
+};
+
+void multiplyCheckedScalar(const double *values, double factor, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = (values[i] < 0) ? -1 : values[i] * factor;
+}
+
+inline double gatherOne(double amount, CurrencyId from, CurrencyId to, const double *crossRates)
+{
+    if (from >= MAX_CURRENCIES || to >= MAX_CURRENCIES || amount < 0)
+        return -1;
+
+    double rate = crossRates[from * MAX_CURRENCIES + to];
+    return (rate < 0) ? -1 : amount * rate;
+}
+
+void gatherMultiplyScalar(const double *amounts, const CurrencyId *from, const CurrencyId *to,
+    const double *crossRates, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = gatherOne(amounts[i], from[i], to[i], crossRates);
+}
+
+void divideScalar(const double *a, const double *b, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] / b[i];
+}
+
+void subtractScalar(const double *a, const double *b, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] - b[i];
+}
+
+void maximumScalar(const double *a, const double *b, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = (a[i] > b[i]) ? a[i] : b[i];
+}
+
+void minimumScalar(const double *a, const double *b, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = (a[i] < b[i]) ? a[i] : b[i];
+}
+
+void windowSumsScalar(const double *prefix, size_t window, double scale, double *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = (prefix[i + window] - prefix[i]) * scale;
+}
+
+#ifdef CC_X86_KERNELS
+
+// Element wise kernels: op is the intrinsic, scalar the tail implementation
+#define CC_BINARY_KERNEL(name, isa, vector, load, store, op, width, scalar) \
+__attribute__((target(isa))) \
+void name(const double *a, const double *b, double *out, size_t count) \
+{ \
+    size_t i = 0; \
+    for (; i + width <= count; i += width) { \
+        vector r = op(load(a + i), load(b + i)); \
+        store(out + i, r); \
+    } \
+    scalar(a + i, b + i, out + i, count - i); \
+}
+
+CC_BINARY_KERNEL(divideSse2, "sse2", __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_div_pd, 2, divideScalar)
+CC_BINARY_KERNEL(subtractSse2, "sse2", __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, 2, subtractScalar)
+CC_BINARY_KERNEL(maximumSse2, "sse2", __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_max_pd, 2, maximumScalar)
+CC_BINARY_KERNEL(minimumSse2, "sse2", __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_min_pd, 2, minimumScalar)
+CC_BINARY_KERNEL(divideAvx2, "avx2", __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_div_pd, 4, divideScalar)
+CC_BINARY_KERNEL(subtractAvx2, "avx2", __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, 4, subtractScalar)
+CC_BINARY_KERNEL(maximumAvx2, "avx2", __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_max_pd, 4, maximumScalar)
+CC_BINARY_KERNEL(minimumAvx2, "avx2", __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_min_pd, 4, minimumScalar)
+
+#undef CC_BINARY_KERNEL
+
+__attribute__((target("sse2")))
+void windowSumsSse2(const double *prefix, size_t window, double scale, double *out, size_t count)
+{
+    const __m128d vscale = _mm_set1_pd(scale);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128d sum = _mm_sub_pd(_mm_loadu_pd(prefix + i + window), _mm_loadu_pd(prefix + i));
+        _mm_storeu_pd(out + i, _mm_mul_pd(sum, vscale));
+    }
+
+    windowSumsScalar(prefix + i, window, scale, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void windowSumsAvx2(const double *prefix, size_t window, double scale, double *out, size_t count)
+{
+    const __m256d vscale = _mm256_set1_pd(scale);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256d sum = _mm256_sub_pd(_mm256_loadu_pd(prefix + i + window), _mm256_loadu_pd(prefix + i));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(sum, vscale));
+    }
+
+    windowSumsScalar(prefix + i, window, scale, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void multiplyCheckedSse2(const double *values, double factor, double *out, size_t count)
+{
+    const __m128d vfactor = _mm_set1_pd(factor);
+    const __m128d vzero = _mm_setzero_pd();
+    const __m128d vinvalid = _mm_set1_pd(-1);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128d v = _mm_loadu_pd(values + i);
+        __m128d invalid = _mm_cmplt_pd(v, vzero);
+        __m128d r = _mm_mul_pd(v, vfactor);
+        r = _mm_or_pd(_mm_and_pd(invalid, vinvalid), _mm_andnot_pd(invalid, r));
+        _mm_storeu_pd(out + i, r);
+    }
+
+    multiplyCheckedScalar(values + i, factor, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void multiplyCheckedAvx2(const double *values, double factor, double *out, size_t count)
+{
+    const __m256d vfactor = _mm256_set1_pd(factor);
+    const __m256d vzero = _mm256_setzero_pd();
+    const __m256d vinvalid = _mm256_set1_pd(-1);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256d v = _mm256_loadu_pd(values + i);
+        __m256d invalid = _mm256_cmp_pd(v, vzero, _CMP_LT_OQ);
+        __m256d r = _mm256_blendv_pd(_mm256_mul_pd(v, vfactor), vinvalid, invalid);
+        _mm256_storeu_pd(out + i, r);
+    }
+
+    multiplyCheckedScalar(values + i, factor, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void gatherMultiplyAvx2(const double *amounts, const CurrencyId *from, const CurrencyId *to,
+    const double *crossRates, double *out, size_t count)
+{
+    const __m128i vmax = _mm_set1_epi32(MAX_CURRENCIES);
+    const __m128i vmask = _mm_set1_epi32(MAX_CURRENCIES - 1);
+    const __m256d vzero = _mm256_setzero_pd();
+    const __m256d vinvalid = _mm256_set1_pd(-1);
+    const __m256d vallLanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        int f, t;
+        __builtin_memcpy(&f, from + i, sizeof(f));
+        __builtin_memcpy(&t, to + i, sizeof(t));
+        __m128i vfrom = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(f));
+        __m128i vto = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(t));
+
+        // Out of range IDs are clamped for the gather, then flagged invalid
+        __m128i inRange = _mm_and_si128(_mm_cmplt_epi32(vfrom, vmax), _mm_cmplt_epi32(vto, vmax));
+        __m128i index = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(vfrom, vmask), 6),
+            _mm_and_si128(vto, vmask));
+
+        __m256d rate = _mm256_mask_i32gather_pd(vzero, crossRates, index, vallLanes, 8);
+        __m256d amount = _mm256_loadu_pd(amounts + i);
+        __m256d valid = _mm256_and_pd(_mm256_cmp_pd(rate, vzero, _CMP_NLT_UQ),
+            _mm256_cmp_pd(amount, vzero, _CMP_NLT_UQ));
+        valid = _mm256_and_pd(valid, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(inRange)));
+
+        __m256d r = _mm256_blendv_pd(vinvalid, _mm256_mul_pd(amount, rate), valid);
+        _mm256_storeu_pd(out + i, r);
+    }
+
+    gatherMultiplyScalar(amounts + i, from + i, to + i, crossRates, out + i, count - i);
+}
+
+static_assert(MAX_CURRENCIES == 64, "gatherMultiplyAvx2 assumes 64 columns");
+
+#endif // CC_X86_KERNELS
+
+const KernelSet SCALAR_KERNELS = { "scalar", multiplyCheckedScalar, gatherMultiplyScalar,
+    divideScalar, subtractScalar, maximumScalar, minimumScalar, windowSumsScalar };
+
+const KernelSet *selectKernels()
+{
+#ifdef CC_X86_KERNELS
+    static const KernelSet AVX2_KERNELS = { "avx2", multiplyCheckedAvx2, gatherMultiplyAvx2,
+        divideAvx2, subtractAvx2, maximumAvx2, minimumAvx2, windowSumsAvx2 };
+    // No gather before AVX2: the scalar gather is as fast as an emulated one
+    static const KernelSet SSE2_KERNELS = { "sse2", multiplyCheckedSse2, gatherMultiplyScalar,
+        divideSse2, subtractSse2, maximumSse2, minimumSse2, windowSumsSse2 };
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &AVX2_KERNELS;
+    if (__builtin_cpu_supports("sse2"))
+        return &SSE2_KERNELS;
+#endif
+    return &SCALAR_KERNELS;
+}
+
+bool forceScalar = false;
+
+const KernelSet *kernels()
+{
+    static const KernelSet *best = selectKernels();
+    return forceScalar ? &SCALAR_KERNELS : best;
+}
+
+} // namespace
+
+void Kernels::MultiplyChecked(const double *values, double factor, double *out, size_t count)
+{
+    kernels()->multiplyChecked(values, factor, out, count);
+}
+
+void Kernels::GatherMultiply(const double *amounts, const CurrencyId *from, const CurrencyId *to,
+    const double *crossRates, double *out, size_t count)
+{
+    kernels()->gatherMultiply(amounts, from, to, crossRates, out, count);
+}
+
+void Kernels::Divide(const double *a, const double *b, double *out, size_t count)
+{
+    kernels()->divide(a, b, out, count);
+}
+
+void Kernels::Subtract(const double *a, const double *b, double *out, size_t count)
+{
+    kernels()->subtract(a, b, out, count);
+}
+
+void Kernels::Maximum(const double *a, const double *b, double *out, size_t count)
+{
+    kernels()->maximum(a, b, out, count);
+}
+
+void Kernels::Minimum(const double *a, const double *b, double *out, size_t count)
+{
+    kernels()->minimum(a, b, out, count);
+}
+
+void Kernels::WindowSums(const double *prefix, size_t window, double scale, double *out, size_t count)
+{
+    kernels()->windowSums(prefix, window, scale, out, count);
+}
+
+const char *Kernels::Implementation()
+{
+    return kernels()->name;
+}
+
+void Kernels::UseScalar(bool scalar)
+{
+    forceScalar = scalar;
+}
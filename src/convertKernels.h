@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_CONVERT_KERNELS_H
+#define CC_CONVERT_KERNELS_H
+
+#include "currency.h"
+#include <stddef.h>
+
+namespace CurrencyConverter {
+
+//
+// Bulk conversion and rate series kernels.
+// Every kernel has a scalar implementation and, on x86, SSE2 and AVX2 ones.
+// The best implementation supported by the running CPU is selected once,
+// on first use. Invalid elements (negative amount, unknown currency) are
+// converted to -1, like RateManager::Convert() does.
+//
+namespace Kernels {
+
+// out[i] = (values[i] < 0) ? -1 : values[i] * factor
+// Used to convert many amounts with one rate, or one amount with many rates
+void MultiplyChecked(const double *values, double factor, double *out, size_t count);
+
+// out[i] = amounts[i] * crossRates[from[i]][to[i]], -1 on invalid elements.
+// crossRates is a MAX_CURRENCIES x MAX_CURRENCIES row major matrix
+void GatherMultiply(const double *amounts, const CurrencyId *from, const CurrencyId *to,
+	const double *crossRates, double *out, size_t count);
+
+// Element wise operations on rate series (see WindowAnalytics):
+// out[i] = a[i] / b[i], a[i] - b[i], max(a[i], b[i]) and min(a[i], b[i])
+void Divide(const double *a, const double *b, double *out, size_t count);
+void Subtract(const double *a, const double *b, double *out, size_t count);
+void Maximum(const double *a, const double *b, double *out, size_t count);
+void Minimum(const double *a, const double *b, double *out, size_t count);
+
+// Sums over sliding windows, from prefix sums:
+// out[i] = (prefix[i + window] - prefix[i]) * scale
+void WindowSums(const double *prefix, size_t window, double scale, double *out, size_t count);
+
+// Name of the implementation in use: "avx2", "sse2" or "scalar"
+const char *Implementation();
+
+// Forces the scalar implementation (benchmarks and comparisons)
+void UseScalar(bool scalar);
+
+} // namespace Kernels
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_CONVERTER_HANDLE_H
+#define CC_CONVERTER_HANDLE_H
+
+#include "currencyconverter.h"
+#include "rateManager.h"
+
+//
+// The C API handle. Not installed: only the tools built along with the
+// library reach the C++ API under it, for what the C API does not cover
+// (daemon, ledger, history...).
+//
+struct cc_converter {
+	CurrencyConverter::RateManager rates;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "currency.h"
+#include <atomic>
+#include <mutex>
+#include <string.h>
+
+using namespace CurrencyConverter;
+
+// Codes of the interned currencies, by ID. A code is written before the
+// count covering it is published, and never changes afterwards
+static char _internedCodes[MAX_CURRENCIES][4];
+static std::atomic<size_t> _numCurrencies(NUM_KNOWN_CURRENCIES);
+static std::mutex _internLock;
+
+static CurrencyId _findInterned(const char *code, size_t numCurrencies)
+{
+    for (size_t id = NUM_KNOWN_CURRENCIES; id < numCurrencies; id++) {
+        if (memcmp(_internedCodes[id], code, 3) == 0)
+            return static_cast<CurrencyId>(id);
+    }
+    return INVALID_CURRENCY;
+}
+
+CurrencyId CurrencyConverter::LookupCurrency(const char *code, size_t len)
+{
+    CurrencyId id = CurrencyIdFromCode(code, len);
+    if (id != INVALID_CURRENCY || len != 3)
+        return id;
+
+    return _findInterned(code, _numCurrencies.load(std::memory_order_acquire));
+}
+
+CurrencyId CurrencyConverter::InternCurrency(const char *code, size_t len)
+{
+    CurrencyId id = LookupCurrency(code, len);
+    if (id != INVALID_CURRENCY || len != 3 || detail::packCode(code) == detail::INVALID_KEY)
+        return id;
+
+    std::lock_guard<std::mutex> lock(_internLock);
+    size_t numCurrencies = _numCurrencies.load(std::memory_order_relaxed);
+    id = _findInterned(code, numCurrencies);
+    if (id != INVALID_CURRENCY || numCurrencies == MAX_CURRENCIES)
+        return id;
+
+    memcpy(_internedCodes[numCurrencies], code, 3);
+    _internedCodes[numCurrencies][3] = '\0';
+    _numCurrencies.store(numCurrencies + 1, std::memory_order_release);
+    return static_cast<CurrencyId>(numCurrencies);
+}
+
+size_t CurrencyConverter::NumCurrencies()
+{
+    return _numCurrencies.load(std::memory_order_acquire);
+}
+
+const char *CurrencyConverter::CurrencyCode(CurrencyId id)
+{
+    if (id < NUM_KNOWN_CURRENCIES)
+        return KNOWN_CURRENCIES[id];
+    return (id < NumCurrencies()) ? _internedCodes[id] : "???";
+}
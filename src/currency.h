@@ -0,0 +1,162 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_CURRENCY_H
+#define CC_CURRENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace CurrencyConverter {
+
+//
+// Currencies are interned as small dense integer IDs so that rate tables
+// can be plain arrays indexed by ID instead of string keyed maps.
+// The ID space covers every currency the European Central Bank publishes
+// or has published in its reference rates (EUR first, then ECB order).
+//
+typedef uint8_t CurrencyId;
+
+static const CurrencyId CURRENCY_EUR = 0;
+static const CurrencyId INVALID_CURRENCY = 0xFF;
+static const size_t MAX_CURRENCIES = 64;
+
+static constexpr const char KNOWN_CURRENCIES[][4] = {
+	"EUR", "USD", "JPY", "BGN", "CYP", "CZK", "DKK", "EEK", "GBP", "HUF",
+	"LTL", "LVL", "MTL", "PLN", "ROL", "RON", "SEK", "SIT", "SKK", "CHF",
+	"ISK", "NOK", "HRK", "RUB", "TRL", "TRY", "AUD", "BRL", "CAD", "CNY",
+	"HKD", "IDR", "ILS", "INR", "KRW", "MXN", "MYR", "NZD", "PHP", "SGD",
+	"THB", "ZAR",
+};
+static constexpr size_t NUM_KNOWN_CURRENCIES = sizeof(KNOWN_CURRENCIES) / sizeof(KNOWN_CURRENCIES[0]);
+static_assert(NUM_KNOWN_CURRENCIES <= MAX_CURRENCIES, "Too many known currencies");
+
+namespace detail {
+
+// A currency code is packed as a base 26 number: 0 <= key < 26^3
+static constexpr uint32_t INVALID_KEY = 0xFFFFFFFF;
+
+constexpr uint32_t packCode(const char *code)
+{
+	for (int i = 0; i < 3; i++) {
+		if (code[i] < 'A' || code[i] > 'Z')
+			return INVALID_KEY;
+	}
+	return (code[0] - 'A') * 676 + (code[1] - 'A') * 26 + (code[2] - 'A');
+}
+
+// Multiplicative hash into a 128 slots table. The multiplier was picked so
+// that no two known currencies collide; this is verified at compile time.
+static constexpr uint32_t HASH_MULTIPLIER = 771789;
+static constexpr unsigned HASH_BITS = 7;
+static constexpr size_t HASH_SLOTS = 1 << HASH_BITS;
+
+constexpr uint32_t hashKey(uint32_t key)
+{
+	return static_cast<uint32_t>(key * HASH_MULTIPLIER) >> (32 - HASH_BITS);
+}
+
+struct HashTable {
+	CurrencyId slots[HASH_SLOTS];
+	uint32_t keys[NUM_KNOWN_CURRENCIES];
+	bool perfect;
+};
+
+constexpr HashTable buildHashTable()
+{
+	HashTable table = {};
+	table.perfect = true;
+	for (size_t i = 0; i < HASH_SLOTS; i++)
+		table.slots[i] = INVALID_CURRENCY;
+
+	for (size_t id = 0; id < NUM_KNOWN_CURRENCIES; id++) {
+		uint32_t key = packCode(KNOWN_CURRENCIES[id]);
+		uint32_t slot = hashKey(key);
+		if (table.slots[slot] != INVALID_CURRENCY)
+			table.perfect = false;
+		table.slots[slot] = static_cast<CurrencyId>(id);
+		table.keys[id] = key;
+	}
+	return table;
+}
+
+static constexpr HashTable CURRENCY_HASH_TABLE = buildHashTable();
+static_assert(CURRENCY_HASH_TABLE.perfect, "Currency hash multiplier is not collision free");
+
+} // namespace detail
+
+// Returns the ID of a 3 letters ISO code, or INVALID_CURRENCY.
+// len is the length of the code: anything but 3 letters is rejected.
+constexpr CurrencyId CurrencyIdFromCode(const char *code, size_t len)
+{
+	if (len != 3)
+		return INVALID_CURRENCY;
+
+	uint32_t key = detail::packCode(code);
+	if (key == detail::INVALID_KEY)
+		return INVALID_CURRENCY;
+
+	CurrencyId id = detail::CURRENCY_HASH_TABLE.slots[detail::hashKey(key)];
+	if (id == INVALID_CURRENCY || detail::CURRENCY_HASH_TABLE.keys[id] != key)
+		return INVALID_CURRENCY;
+
+	return id;
+}
+
+static_assert(CurrencyIdFromCode("EUR", 3) == CURRENCY_EUR, "EUR must be ID 0");
+static_assert(CurrencyIdFromCode("XXX", 3) == INVALID_CURRENCY, "Unknown code must not resolve");
+
+//
+// Currencies ECB never published, e.g. quoted by other central banks, are
+// interned at runtime into the free IDs, from NUM_KNOWN_CURRENCIES up to
+// MAX_CURRENCIES - 1, for the process lifetime. Lookups never lock.
+//
+
+// ID of a known or interned currency, or INVALID_CURRENCY
+CurrencyId LookupCurrency(const char *code, size_t len);
+
+// Same, interning the code if it is new. Returns INVALID_CURRENCY if the
+// code is not 3 capital letters, or if every ID is taken
+CurrencyId InternCurrency(const char *code, size_t len);
+
+// Number of known and interned currencies: IDs are below it
+size_t NumCurrencies();
+
+// "???" for an ID that is neither known nor interned
+const char *CurrencyCode(CurrencyId id);
+
+// ISO 4217 minor units: number of decimals of the smallest amount of each
+// currency, in KNOWN_CURRENCIES order (cents: 2, yen: 0)
+static constexpr uint8_t KNOWN_CURRENCIES_MINOR_UNITS[] = {
+	2, 2, 0, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	0, 2, 2, 2, 0, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 0, 2, 2, 2, 2, 2,
+	2, 2,
+};
+static_assert(sizeof(KNOWN_CURRENCIES_MINOR_UNITS) == NUM_KNOWN_CURRENCIES, "Missing currency minor units");
+
+inline unsigned CurrencyMinorUnits(CurrencyId id)
+{
+	return (id < NUM_KNOWN_CURRENCIES) ? KNOWN_CURRENCIES_MINOR_UNITS[id] : 2;
+}
+
+} // namespace CurrencyConverter
+
+#endif
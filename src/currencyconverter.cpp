@@ -0,0 +1,250 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "converterHandle.h"
+#include "metrics.h"
+#include <math.h>
+#include <string.h>
+#include <new>
+
+using namespace CurrencyConverter;
+
+static const char *STATUS_STRINGS[] = {
+    "success",
+    "invalid argument",
+    "out of memory",
+    "exchange rates not available",
+    "unknown currency",
+    "invalid amount",
+};
+
+// Exceptions must not unwind into C callers
+template <typename Body>
+static cc_status _guard(Body body)
+{
+    try {
+        return body();
+    } catch (const std::bad_alloc &) {
+        return CC_ERROR_OUT_OF_MEMORY;
+    } catch (...) {
+        return CC_ERROR_NO_RATES;
+    }
+}
+
+static bool _validAmount(double amount)
+{
+    return isfinite(amount) && amount >= 0;
+}
+
+// Loads rates if needed and resolves the currency code
+static cc_status _resolve(cc_converter *converter, const char *code, CurrencyId *id)
+{
+    if (!converter || !code)
+        return CC_ERROR_INVALID_ARGUMENT;
+
+    if (converter->rates.LoadRates() < 0)
+        return CC_ERROR_NO_RATES;
+
+    *id = LookupCurrency(code, strlen(code));
+    if (*id == INVALID_CURRENCY)
+        return CC_ERROR_UNKNOWN_CURRENCY;
+
+    return CC_OK;
+}
+
+const char *cc_version(void)
+{
+    return VERSION;
+}
+
+const char *cc_status_string(cc_status status)
+{
+    if (status > CC_OK || -status >= (int) (sizeof(STATUS_STRINGS) / sizeof(STATUS_STRINGS[0])))
+        return "unknown error";
+    return STATUS_STRINGS[-status];
+}
+
+int cc_currency_id(const char *code)
+{
+    CurrencyId id = code ? LookupCurrency(code, strlen(code)) : INVALID_CURRENCY;
+    return (id == INVALID_CURRENCY) ? CC_ERROR_UNKNOWN_CURRENCY : id;
+}
+
+const char *cc_currency_code(int id)
+{
+    return (id >= 0 && (size_t) id < NumCurrencies()) ? CurrencyCode(id) : NULL;
+}
+
+cc_status cc_open(cc_converter **converter)
+{
+    if (!converter)
+        return CC_ERROR_INVALID_ARGUMENT;
+
+    *converter = NULL;
+    return _guard([&] {
+        *converter = new cc_converter();
+        return CC_OK;
+    });
+}
+
+void cc_close(cc_converter *converter)
+{
+    delete converter;
+}
+
+cc_status cc_add_source(cc_converter *converter, const char *spec, unsigned timeout_ms)
+{
+    if (!converter || !spec)
+        return CC_ERROR_INVALID_ARGUMENT;
+    return _guard([&] {
+        return (converter->rates.AddRateSource(spec, timeout_ms) < 0) ? CC_ERROR_INVALID_ARGUMENT : CC_OK;
+    });
+}
+
+cc_status cc_add_quotes(cc_converter *converter, const char *path)
+{
+    if (!converter || !path)
+        return CC_ERROR_INVALID_ARGUMENT;
+    return _guard([&] {
+        return (converter->rates.AddRateQuotes(path) < 0) ? CC_ERROR_INVALID_ARGUMENT : CC_OK;
+    });
+}
+
+cc_status cc_load_rates(cc_converter *converter)
+{
+    if (!converter)
+        return CC_ERROR_INVALID_ARGUMENT;
+    return _guard([&] {
+        return (converter->rates.LoadRates() < 0) ? CC_ERROR_NO_RATES : CC_OK;
+    });
+}
+
+cc_status cc_refresh_rates(cc_converter *converter)
+{
+    if (!converter)
+        return CC_ERROR_INVALID_ARGUMENT;
+    return _guard([&] {
+        return (converter->rates.RefreshRates() < 0) ? CC_ERROR_NO_RATES : CC_OK;
+    });
+}
+
+cc_status cc_rates_date(cc_converter *converter, int64_t *date)
+{
+    if (!converter || !date)
+        return CC_ERROR_INVALID_ARGUMENT;
+
+    return _guard([&] {
+        *date = converter->rates.GetRatesLastUpdatedDate();
+        return (*date == 0) ? CC_ERROR_NO_RATES : CC_OK;
+    });
+}
+
+static cc_status _convert(cc_converter *converter, double amount, const char *from, const char *to, double *out)
+{
+    CurrencyId fromId;
+    CurrencyId toId;
+    cc_status status;
+
+    if (!to || !out)
+        return CC_ERROR_INVALID_ARGUMENT;
+    if ((status = _resolve(converter, from, &fromId)) != CC_OK)
+        return status;
+    toId = LookupCurrency(to, strlen(to));
+    if (!_validAmount(amount))
+        return CC_ERROR_INVALID_AMOUNT;
+
+    // Negative for the currencies without a rate
+    *out = converter->rates.Convert(amount, fromId, toId);
+    return (*out < 0) ? CC_ERROR_UNKNOWN_CURRENCY : CC_OK;
+}
+
+cc_status cc_convert(cc_converter *converter, double amount, const char *from, const char *to, double *out)
+{
+    StageTimer timer(STAGE_CONVERT);
+    cc_status status = _guard([&] {
+        return _convert(converter, amount, from, to, out);
+    });
+    if (status != CC_OK)
+        Metrics::Increment(COUNTER_CONVERSION_ERRORS);
+    return status;
+}
+
+static cc_status _convertMany(cc_converter *converter, const double *amounts,
+    double *out, size_t count, const char *from, const char *to)
+{
+    CurrencyId fromId;
+    cc_status status;
+
+    if (!to || (count && (!amounts || !out)))
+        return CC_ERROR_INVALID_ARGUMENT;
+    if ((status = _resolve(converter, from, &fromId)) != CC_OK)
+        return status;
+
+    CurrencyId toId = LookupCurrency(to, strlen(to));
+    if (converter->rates.ConvertMany(amounts, out, count, fromId, toId) < 0)
+        return CC_ERROR_UNKNOWN_CURRENCY;
+
+    // Invalid elements come out negative
+    status = CC_OK;
+    for (size_t i = 0; i < count; i++) {
+        if (!(out[i] >= 0) || !_validAmount(amounts[i])) {
+            out[i] = NAN;
+            status = CC_ERROR_INVALID_AMOUNT;
+        }
+    }
+    return status;
+}
+
+static cc_status _convertToAll(cc_converter *converter, double amount, const char *from, double *out)
+{
+    CurrencyId fromId;
+    cc_status status;
+
+    if (!out)
+        return CC_ERROR_INVALID_ARGUMENT;
+    if ((status = _resolve(converter, from, &fromId)) != CC_OK)
+        return status;
+    if (!_validAmount(amount))
+        return CC_ERROR_INVALID_AMOUNT;
+
+    if (converter->rates.ConvertToAll(amount, fromId, out) < 0)
+        return CC_ERROR_UNKNOWN_CURRENCY;
+
+    static_assert(CC_MAX_CURRENCIES == MAX_CURRENCIES, "C API currency IDs must match");
+    for (size_t id = 0; id < MAX_CURRENCIES; id++) {
+        if (out[id] < 0)
+            out[id] = NAN;
+    }
+    return CC_OK;
+}
+
+cc_status cc_convert_many(cc_converter *converter, const double *amounts,
+    double *out, size_t count, const char *from, const char *to)
+{
+    return _guard([&] {
+        return _convertMany(converter, amounts, out, count, from, to);
+    });
+}
+
+cc_status cc_convert_to_all(cc_converter *converter, double amount, const char *from, double *out)
+{
+    return _guard([&] {
+        return _convertToAll(converter, amount, from, out);
+    });
+}
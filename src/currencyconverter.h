@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CURRENCYCONVERTER_H
+#define CURRENCYCONVERTER_H
+
+/*
+ * CurrencyConverter C API: conversions at the European Central Bank
+ * reference rates, in process.
+ *
+ * A converter handle owns its rates: they are loaded from the local cache,
+ * or downloaded from ECB when outdated, on first conversion or on
+ * cc_load_rates(). Conversions may then run from any number of threads on
+ * the same handle without locking; cc_load_rates() and cc_refresh_rates()
+ * may run concurrently with them.
+ *
+ * Functions return CC_OK or a negative cc_status, never throw nor print
+ * anything for conversion errors: CC_ERROR_OUT_OF_MEMORY whenever memory
+ * runs out. Download failures are reported on stderr.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CC_EXPORT __attribute__((visibility("default")))
+#else
+#define CC_EXPORT
+#endif
+
+typedef struct cc_converter cc_converter;
+
+typedef enum cc_status {
+	CC_OK = 0,
+	CC_ERROR_INVALID_ARGUMENT = -1,	/* NULL handle or pointer, bad source */
+	CC_ERROR_OUT_OF_MEMORY = -2,
+	CC_ERROR_NO_RATES = -3,		/* Rates can't be loaded nor downloaded */
+	CC_ERROR_UNKNOWN_CURRENCY = -4,	/* Not an ECB currency, or not quoted */
+	CC_ERROR_INVALID_AMOUNT = -5,	/* Negative or not a number */
+} cc_status;
+
+/* Size of the arrays indexed by currency ID */
+#define CC_MAX_CURRENCIES 64
+
+CC_EXPORT const char *cc_version(void);
+CC_EXPORT const char *cc_status_string(cc_status status);
+
+/* Currency IDs, 0 to CC_MAX_CURRENCIES - 1, index cc_convert_to_all()
+ * results. cc_currency_id() returns CC_ERROR_UNKNOWN_CURRENCY for codes
+ * that are not ECB ones, cc_currency_code() NULL for unused IDs */
+CC_EXPORT int cc_currency_id(const char *code);
+CC_EXPORT const char *cc_currency_code(int id);
+
+CC_EXPORT cc_status cc_open(cc_converter **converter);
+CC_EXPORT void cc_close(cc_converter *converter);
+
+/* Gets rates from this source instead of ECB: an http(s):// URL, a
+ * file:// URL or path, or a directory of ECB documents. Sources added
+ * several times are raced, see the README. Call before loading rates */
+CC_EXPORT cc_status cc_add_source(cc_converter *converter, const char *spec, unsigned timeout_ms);
+
+/* Adds rates quoted by other sources, with any base: a text file of
+ * "<base> <quote> <rate>" lines. Conversions then follow the shortest
+ * path through ECB rates and quotes. Currencies ECB does not publish get
+ * IDs above the known ones, see cc_currency_code */
+CC_EXPORT cc_status cc_add_quotes(cc_converter *converter, const char *path);
+
+/* Loads rates if not loaded yet; reloads them if outdated, keeping the
+ * current ones on failure. Both return CC_ERROR_NO_RATES on failure */
+CC_EXPORT cc_status cc_load_rates(cc_converter *converter);
+CC_EXPORT cc_status cc_refresh_rates(cc_converter *converter);
+/* ECB publication time (time_t) of the rates in use */
+CC_EXPORT cc_status cc_rates_date(cc_converter *converter, int64_t *date);
+
+/* Converts amount from one ISO 4217 code into another */
+CC_EXPORT cc_status cc_convert(cc_converter *converter, double amount,
+	const char *from, const char *to, double *out);
+/* Converts count amounts of the same pair, all with the same rates.
+ * Invalid amounts are converted into NAN, and CC_ERROR_INVALID_AMOUNT
+ * is returned once all the others are converted */
+CC_EXPORT cc_status cc_convert_many(cc_converter *converter, const double *amounts,
+	double *out, size_t count, const char *from, const char *to);
+/* Converts amount into every currency: out holds CC_MAX_CURRENCIES values,
+ * indexed by currency ID, NAN for the currencies without a rate */
+CC_EXPORT cc_status cc_convert_to_all(cc_converter *converter, double amount,
+	const char *from, double *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,497 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "daemon.h"
+#include "utils.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace CurrencyConverter;
+
+static const int MAX_EVENTS = 64;
+static const int LISTEN_BACKLOG = 128;
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+// A client that does not read its responses stops being read from
+static const size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+// Requests a streaming client may have in flight before waiting for responses
+static const uint64_t CLIENT_MAX_IN_FLIGHT = 4096;
+
+// Period of the metrics file updates
+static const int METRICS_INTERVAL_MS = 15000;
+
+static volatile sig_atomic_t _stopDaemon = 0;
+
+static void _onStopSignal(int)
+{
+    _stopDaemon = 1;
+}
+
+struct Connection {
+    int fd;
+    std::vector<char> in;
+    std::vector<char> out;
+    size_t outPos;
+    uint32_t events;
+    bool eof;           // Client is done sending: close once answered
+};
+
+static bool _fillSocketAddress(const std::string &socketPath, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr->sun_path)) {
+        std::cerr << "ERROR: Socket path is too long: " << socketPath << '\n';
+        return false;
+    }
+
+    memcpy(addr->sun_path, socketPath.c_str(), socketPath.size());
+    return true;
+}
+
+static int _listen(const std::string &socketPath)
+{
+    struct sockaddr_un addr;
+    if (!_fillSocketAddress(socketPath, &addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    // Remove a socket left behind by a previous instance, unless an
+    // instance still answers on it. Anything else there is left alone
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << "ERROR: " << socketPath << " is not a socket\n";
+            close(fd);
+            return -1;
+        }
+
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe < 0) {
+            close(fd);
+            return -1;
+        }
+        bool answered = connect(probe, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+        close(probe);
+        if (answered) {
+            std::cerr << "ERROR: A daemon is already listening on " << socketPath << '\n';
+            close(fd);
+            return -1;
+        }
+        unlink(socketPath.c_str());
+    }
+
+    // The socket is only meant for the current user
+    mode_t mask = umask(0077);
+    int ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    umask(mask);
+
+    if (ret < 0 || listen(fd, LISTEN_BACKLOG) < 0) {
+        std::cerr << "ERROR: Failed to listen on " << socketPath << ": " << strerror(errno) << '\n';
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void _serveRequests(RateManager &rr, Connection *conn)
+{
+    size_t numRequests = conn->in.size() / sizeof(DaemonRequest);
+    if (numRequests == 0)
+        return;
+
+    StageTimer timer(STAGE_DAEMON_BATCH);
+    Metrics::Increment(COUNTER_DAEMON_REQUESTS, numRequests);
+
+    const DaemonRequest *requests = (const DaemonRequest *) conn->in.data();
+    size_t outLen = conn->out.size();
+    conn->out.resize(outLen + numRequests * sizeof(DaemonResponse));
+    DaemonResponse *responses = (DaemonResponse *) (conn->out.data() + outLen);
+    int64_t ratesDate = rr.GetRatesLastUpdatedDate();
+
+    for (size_t i = 0; i < numRequests; i++) {
+        const DaemonRequest &request = requests[i];
+        CurrencyId from = LookupCurrency(request.from, strnlen(request.from, sizeof(request.from)));
+        CurrencyId to = LookupCurrency(request.to, strnlen(request.to, sizeof(request.to)));
+        double amount = rr.Convert(request.amount, from, to);
+
+        responses[i].amount = amount;
+        responses[i].ratesDate = ratesDate;
+        responses[i].tag = request.tag;
+        responses[i].status = (amount < 0) ? -1 : 0;
+    }
+
+    // Keep a trailing partial request for the next read
+    conn->in.erase(conn->in.begin(), conn->in.begin() + numRequests * sizeof(DaemonRequest));
+}
+
+// Returns -1 if the connection failed
+static int _flush(Connection *conn)
+{
+    while (conn->outPos < conn->out.size()) {
+        ssize_t len = send(conn->fd, conn->out.data() + conn->outPos, conn->out.size() - conn->outPos,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        conn->outPos += len;
+    }
+
+    if (conn->outPos == conn->out.size()) {
+        conn->out.clear();
+        conn->outPos = 0;
+    }
+
+    return 0;
+}
+
+// Returns -1 if the connection failed
+static int _read(RateManager &rr, Connection *conn)
+{
+    char buffer[READ_CHUNK_SIZE];
+
+    while (!conn->eof && conn->out.size() - conn->outPos < MAX_PENDING_OUTPUT) {
+        ssize_t len = read(conn->fd, buffer, sizeof(buffer));
+        if (len == 0) {
+            conn->eof = true;
+            break;
+        }
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        conn->in.insert(conn->in.end(), buffer, buffer + len);
+        _serveRequests(rr, conn);
+    }
+
+    return 0;
+}
+
+static int _updateEvents(int epollFd, Connection *conn)
+{
+    // Wait for the client to drain its responses before reading more requests
+    size_t pending = conn->out.size() - conn->outPos;
+    uint32_t events = 0;
+    if (!conn->eof && pending < MAX_PENDING_OUTPUT)
+        events |= EPOLLIN | EPOLLRDHUP;
+    if (pending > 0)
+        events |= EPOLLOUT;
+
+    if (events == conn->events)
+        return 0;
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = conn;
+    conn->events = events;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+static void _close(int epollFd, Connection *conn)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    delete conn;
+}
+
+static void _accept(int epollFd, int listenFd)
+{
+    for (;;) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        Connection *conn = new Connection();
+        conn->fd = fd;
+        conn->outPos = 0;
+        conn->events = EPOLLIN | EPOLLRDHUP;
+        conn->eof = false;
+
+        struct epoll_event ev;
+        ev.events = conn->events;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            delete conn;
+        }
+    }
+}
+
+int CurrencyConverter::RunDaemon(RateManager &rr, const std::string &socketPath,
+    const std::string &metricsFileName)
+{
+    // Rates are kept fresh in the background: the event loop never waits on ECB
+    rr.StartBackgroundRefresh();
+
+    int listenFd = _listen(socketPath);
+    if (listenFd < 0)
+        return -1;
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0) {
+        close(listenFd);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _onStopSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct epoll_event events[MAX_EVENTS];
+    bool exportMetrics = !metricsFileName.empty();
+    uint64_t nextMetricsExport = Metrics::Now();
+
+    while (!_stopDaemon) {
+        if (exportMetrics && Metrics::Now() >= nextMetricsExport) {
+            Metrics::WritePrometheusFile(metricsFileName);
+            nextMetricsExport = Metrics::Now() + METRICS_INTERVAL_MS * 1000000ULL;
+        }
+
+        int n = epoll_wait(epollFd, events, MAX_EVENTS, exportMetrics ? METRICS_INTERVAL_MS : -1);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < n; i++) {
+            Connection *conn = (Connection *) events[i].data.ptr;
+            if (!conn) {
+                _accept(epollFd, listenFd);
+                continue;
+            }
+
+            bool failed = (events[i].events & EPOLLERR) != 0;
+            if (!failed && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+                failed = _read(rr, conn) < 0;
+            if (!failed)
+                failed = _flush(conn) < 0 || _updateEvents(epollFd, conn) < 0;
+
+            if (failed || (conn->eof && conn->out.empty()))
+                _close(epollFd, conn);
+        }
+    }
+
+    close(epollFd);
+    close(listenFd);
+    unlink(socketPath.c_str());
+    rr.StopBackgroundRefresh();
+    if (exportMetrics)
+        Metrics::WritePrometheusFile(metricsFileName);
+    return 0;
+}
+
+static int _connect(const std::string &socketPath)
+{
+    struct sockaddr_un addr;
+    if (!_fillSocketAddress(socketPath, &addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        std::cerr << "ERROR: Failed to connect to " << socketPath << ": " << strerror(errno) << '\n';
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void _fillRequest(DaemonRequest *request, uint32_t tag, double amount, const char *from, const char *to)
+{
+    memset(request, 0, sizeof(*request));
+    request->amount = amount;
+    request->tag = tag;
+
+    // Anything but a 3 letters code is sent empty: the daemon rejects it
+    if (strlen(from) == 3)
+        memcpy(request->from, from, 3);
+    if (strlen(to) == 3)
+        memcpy(request->to, to, 3);
+}
+
+static bool _sendAll(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+
+    return true;
+}
+
+int CurrencyConverter::DaemonConvert(const std::string &socketPath, double amount,
+    const std::string &fromCurrency, const std::string &toCurrency,
+    double *convertedAmount, time_t *ratesDate)
+{
+    int fd = _connect(socketPath);
+    if (fd < 0)
+        return -1;
+
+    DaemonRequest request;
+    DaemonResponse response;
+    _fillRequest(&request, 0, amount, fromCurrency.c_str(), toCurrency.c_str());
+
+    bool ok = _sendAll(fd, (const char *) &request, sizeof(request))
+        && recv(fd, &response, sizeof(response), MSG_WAITALL) == (ssize_t) sizeof(response);
+    close(fd);
+
+    if (!ok || response.status < 0)
+        return -1;
+
+    *convertedAmount = response.amount;
+    *ratesDate = response.ratesDate;
+    return 0;
+}
+
+int CurrencyConverter::RunClientStream(const std::string &socketPath)
+{
+    int fd = _connect(socketPath);
+    if (fd < 0)
+        return -1;
+
+    std::vector<char> line;
+    std::vector<char> out;
+    std::vector<char> in;
+    size_t outPos = 0;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    bool stdinEof = false;
+    char buffer[READ_CHUNK_SIZE];
+
+    while (!stdinEof || received < sent) {
+        struct pollfd fds[2];
+        bool readInput = !stdinEof && (sent - received) < CLIENT_MAX_IN_FLIGHT;
+        fds[0].fd = readInput ? STDIN_FILENO : -1;
+        fds[0].events = POLLIN;
+        fds[1].fd = fd;
+        fds[1].events = POLLIN | (outPos < out.size() ? POLLOUT : 0);
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (readInput && (fds[0].revents & (POLLIN | POLLHUP))) {
+            ssize_t len = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (len <= 0) {
+                stdinEof = true;
+                // Last record may lack its end of line
+                len = 0;
+                if (!line.empty())
+                    buffer[len++] = '\n';
+            }
+
+            for (ssize_t i = 0; i < len; i++) {
+                if (buffer[i] != '\n') {
+                    line.push_back(buffer[i]);
+                    continue;
+                }
+
+                line.push_back('\0');
+                // Blank lines get no answer, like the local stream mode
+                if (line[strspn(line.data(), " \t\r")] != '\0') {
+                    char from[16] = {}, to[16] = {};
+                    double amount = -1;
+                    if (sscanf(line.data(), "%lf %15s %15s", &amount, from, to) != 3)
+                        from[0] = '\0';
+
+                    size_t outLen = out.size();
+                    out.resize(outLen + sizeof(DaemonRequest));
+                    _fillRequest((DaemonRequest *) (out.data() + outLen), sent, amount, from, to);
+                    sent++;
+                }
+                line.clear();
+            }
+        }
+
+        // Send what can be sent without blocking
+        while (outPos < out.size()) {
+            ssize_t len = send(fd, out.data() + outPos, out.size() - outPos, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (len < 0)
+                break;
+            outPos += len;
+        }
+        if (outPos == out.size()) {
+            out.clear();
+            outPos = 0;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+                std::cerr << "ERROR: Connection to " << socketPath << " lost\n";
+                break;
+            }
+
+            if (len > 0) {
+                in.insert(in.end(), buffer, buffer + len);
+                size_t numResponses = in.size() / sizeof(DaemonResponse);
+                const DaemonResponse *responses = (const DaemonResponse *) in.data();
+                for (size_t i = 0; i < numResponses; i++) {
+                    if (responses[i].status == 0)
+                        printf("%.2f\n", responses[i].amount);
+                    else
+                        fputs("ERROR\n", stdout);
+                }
+                fflush(stdout);
+                received += numResponses;
+                in.erase(in.begin(), in.begin() + numResponses * sizeof(DaemonResponse));
+            }
+        }
+    }
+
+    close(fd);
+    return (received == sent && stdinEof) ? 0 : -1;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_DAEMON_H
+#define CC_DAEMON_H
+
+#include "rateManager.h"
+#include <stdint.h>
+#include <string>
+
+namespace CurrencyConverter {
+
+//
+// Resident conversion service over a Unix domain socket.
+//
+// The protocol is a stream of fixed size records in host byte order.
+// A client may write any number of requests before reading: responses are
+// sent back in request order, one per request, carrying the request tag.
+//
+struct DaemonRequest {
+	double amount;
+	uint32_t tag;		// Echoed back in the response
+	char from[4];		// ISO 4217 codes, NUL padded
+	char to[4];
+	uint32_t reserved;
+};
+
+struct DaemonResponse {
+	double amount;		// Converted amount
+	int64_t ratesDate;	// ECB publication date of the rates used (time_t)
+	uint32_t tag;
+	int32_t status;		// 0 on success, -1 on invalid amount or currency
+};
+
+static_assert(sizeof(DaemonRequest) == 24, "Unexpected daemon request layout");
+static_assert(sizeof(DaemonResponse) == 24, "Unexpected daemon response layout");
+
+// Serves conversions on socketPath until SIGINT or SIGTERM.
+// Unless metricsFileName is empty, metrics are periodically written there
+// in Prometheus text format
+int RunDaemon(RateManager &rr, const std::string &socketPath, const std::string &metricsFileName);
+
+// Client side: one conversion through the daemon. Returns 0 on success
+int DaemonConvert(const std::string &socketPath, double amount,
+	const std::string &fromCurrency, const std::string &toCurrency,
+	double *convertedAmount, time_t *ratesDate);
+
+// Client side of the stream mode: '<amount> <from> <to>' lines are read
+// from stdin and pipelined to the daemon, answers are written to stdout
+int RunClientStream(const std::string &socketPath);
+
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ecbCalendar.h"
+#include <stdint.h>
+
+using namespace CurrencyConverter;
+
+static const int SECONDS_PER_DAY = 86400;
+
+namespace {
+
+constexpr int FIRST_DAY = CivilToDay(TARGET_FIRST_YEAR, 1, 1);
+constexpr int END_DAY = CivilToDay(TARGET_LAST_YEAR + 1, 1, 1);
+constexpr int NUM_DAYS = END_DAY - FIRST_DAY;
+
+// A bit per day of the calendar years, set on closing days
+struct TargetCalendar {
+    uint64_t closed[(NUM_DAYS + 63) / 64];
+
+    constexpr void close(int day)
+    {
+        closed[(day - FIRST_DAY) / 64] |= (uint64_t) 1 << ((day - FIRST_DAY) % 64);
+    }
+
+    constexpr bool isClosed(int day) const
+    {
+        return (closed[(day - FIRST_DAY) / 64] >> ((day - FIRST_DAY) % 64)) & 1;
+    }
+};
+
+// 1970-01-01 was a Thursday: Monday is 0
+constexpr int weekday(int day)
+{
+    return ((day % 7) + 10) % 7;
+}
+
+constexpr TargetCalendar buildTargetCalendar()
+{
+    TargetCalendar calendar = {};
+    for (int day = FIRST_DAY; day < END_DAY; day++) {
+        if (weekday(day) >= 5)
+            calendar.close(day);
+    }
+
+    for (int year = TARGET_FIRST_YEAR; year <= TARGET_LAST_YEAR; year++) {
+        const int easter = EasterSunday(year);
+        calendar.close(CivilToDay(year, 1, 1));
+        calendar.close(easter - 2);
+        calendar.close(easter + 1);
+        calendar.close(CivilToDay(year, 5, 1));
+        calendar.close(CivilToDay(year, 12, 25));
+        calendar.close(CivilToDay(year, 12, 26));
+    }
+    return calendar;
+}
+
+constexpr TargetCalendar TARGET_CALENDAR = buildTargetCalendar();
+
+constexpr bool isPublicationDay(int day)
+{
+    if (day < FIRST_DAY || day >= END_DAY)
+        return weekday(day) < 5;
+    return !TARGET_CALENDAR.isClosed(day);
+}
+
+// Easter dates, the earliest and latest ones of the calendar included
+static_assert(EasterSunday(2008) == CivilToDay(2008, 3, 23), "Easter 2008");
+static_assert(EasterSunday(2011) == CivilToDay(2011, 4, 24), "Easter 2011");
+static_assert(EasterSunday(2019) == CivilToDay(2019, 4, 21), "Easter 2019");
+static_assert(EasterSunday(2024) == CivilToDay(2024, 3, 31), "Easter 2024");
+static_assert(EasterSunday(2025) == CivilToDay(2025, 4, 20), "Easter 2025");
+static_assert(EasterSunday(2026) == CivilToDay(2026, 4, 5), "Easter 2026");
+static_assert(EasterSunday(2038) == CivilToDay(2038, 4, 25), "Easter 2038");
+static_assert(EasterSunday(2095) == CivilToDay(2095, 4, 24), "Easter 2095");
+
+static_assert(weekday(CivilToDay(2026, 10, 19)) == 0, "2026-10-19 is a Monday");
+
+// Closing days...
+static_assert(!isPublicationDay(CivilToDay(2002, 1, 1)), "New Year's Day 2002");
+static_assert(!isPublicationDay(CivilToDay(2019, 4, 19)), "Good Friday 2019");
+static_assert(!isPublicationDay(CivilToDay(2019, 4, 22)), "Easter Monday 2019");
+static_assert(!isPublicationDay(CivilToDay(2024, 3, 29)), "Good Friday 2024");
+static_assert(!isPublicationDay(CivilToDay(2024, 4, 1)), "Easter Monday 2024");
+static_assert(!isPublicationDay(CivilToDay(2024, 5, 1)), "Labour Day 2024");
+static_assert(!isPublicationDay(CivilToDay(2024, 12, 25)), "Christmas Day 2024");
+static_assert(!isPublicationDay(CivilToDay(2024, 12, 26)), "Boxing Day 2024");
+static_assert(!isPublicationDay(CivilToDay(2025, 1, 1)), "New Year's Day 2025");
+static_assert(!isPublicationDay(CivilToDay(2025, 4, 18)), "Good Friday 2025");
+static_assert(!isPublicationDay(CivilToDay(2025, 4, 21)), "Easter Monday 2025");
+static_assert(!isPublicationDay(CivilToDay(2026, 4, 3)), "Good Friday 2026");
+static_assert(!isPublicationDay(CivilToDay(2026, 4, 6)), "Easter Monday 2026");
+static_assert(!isPublicationDay(CivilToDay(2026, 10, 17)), "Saturday");
+static_assert(!isPublicationDay(CivilToDay(2099, 12, 25)), "Christmas Day 2099");
+// ...and days ECB publishes on, holidays of some countries or not
+static_assert(isPublicationDay(CivilToDay(2024, 4, 2)), "Tuesday after Easter 2024");
+static_assert(isPublicationDay(CivilToDay(2024, 12, 24)), "Christmas Eve 2024");
+static_assert(isPublicationDay(CivilToDay(2024, 12, 31)), "New Year's Eve 2024");
+static_assert(isPublicationDay(CivilToDay(2025, 5, 29)), "Ascension Day 2025");
+static_assert(isPublicationDay(CivilToDay(2025, 6, 9)), "Whit Monday 2025");
+static_assert(isPublicationDay(CivilToDay(2026, 10, 19)), "Monday");
+static_assert(isPublicationDay(CivilToDay(2100, 1, 1)), "Out of the calendar: weekdays");
+
+// Day and time of day of a time, UTC
+constexpr void splitTime(time_t time, int *day, int *timeOfDay)
+{
+    *day = (int) (time / SECONDS_PER_DAY);
+    *timeOfDay = (int) (time % SECONDS_PER_DAY);
+    if (*timeOfDay < 0) {
+        (*day)--;
+        *timeOfDay += SECONDS_PER_DAY;
+    }
+}
+
+constexpr time_t lastPublicationTime(time_t now, const PublicationPolicy &policy)
+{
+    int day = 0, timeOfDay = 0;
+    splitTime(now, &day, &timeOfDay);
+
+    // Before today's publication, if any: the last one was on an earlier day
+    if (timeOfDay < policy.TimeOfDay())
+        day--;
+    while (!isPublicationDay(day))
+        day--;
+
+    return (time_t) day * SECONDS_PER_DAY + policy.TimeOfDay();
+}
+
+constexpr time_t nextPublicationTime(time_t now, const PublicationPolicy &policy)
+{
+    int day = 0, timeOfDay = 0;
+    splitTime(now, &day, &timeOfDay);
+
+    if (timeOfDay >= policy.TimeOfDay())
+        day++;
+    while (!isPublicationDay(day))
+        day++;
+
+    return (time_t) day * SECONDS_PER_DAY + policy.TimeOfDay();
+}
+
+constexpr time_t utcTime(int year, int month, int mday, int hour, int minute, int second)
+{
+    return (time_t) CivilToDay(year, month, mday) * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+}
+
+constexpr time_t lastEcb(time_t now) { return lastPublicationTime(now, ECB_PUBLICATION_POLICY); }
+constexpr time_t nextEcb(time_t now) { return nextPublicationTime(now, ECB_PUBLICATION_POLICY); }
+
+// At the cutoff, and a second before it (Monday 2026-10-19)
+static_assert(lastEcb(utcTime(2026, 10, 19, 15, 30, 0)) == utcTime(2026, 10, 19, 15, 30, 0), "At the cutoff");
+static_assert(nextEcb(utcTime(2026, 10, 19, 15, 30, 0)) == utcTime(2026, 10, 20, 15, 30, 0), "At the cutoff");
+static_assert(lastEcb(utcTime(2026, 10, 19, 15, 29, 59)) == utcTime(2026, 10, 16, 15, 30, 0), "Before the cutoff");
+static_assert(nextEcb(utcTime(2026, 10, 19, 15, 29, 59)) == utcTime(2026, 10, 19, 15, 30, 0), "Before the cutoff");
+// Friday evening to the week-end
+static_assert(lastEcb(utcTime(2026, 10, 16, 20, 0, 0)) == utcTime(2026, 10, 16, 15, 30, 0), "Friday evening");
+static_assert(nextEcb(utcTime(2026, 10, 16, 20, 0, 0)) == utcTime(2026, 10, 19, 15, 30, 0), "Friday evening");
+static_assert(lastEcb(utcTime(2026, 10, 18, 23, 59, 59)) == utcTime(2026, 10, 16, 15, 30, 0), "Sunday night");
+// Good Friday to Easter Monday 2026
+static_assert(nextEcb(utcTime(2026, 4, 2, 16, 0, 0)) == utcTime(2026, 4, 7, 15, 30, 0), "Easter 2026");
+static_assert(lastEcb(utcTime(2026, 4, 6, 18, 0, 0)) == utcTime(2026, 4, 2, 15, 30, 0), "Easter 2026");
+// Christmas 2023: week-end, then 25 and 26 December
+static_assert(nextEcb(utcTime(2023, 12, 22, 15, 30, 0)) == utcTime(2023, 12, 27, 15, 30, 0), "Christmas 2023");
+static_assert(lastEcb(utcTime(2023, 12, 27, 15, 29, 59)) == utcTime(2023, 12, 22, 15, 30, 0), "Christmas 2023");
+
+} // namespace
+
+bool CurrencyConverter::IsEcbPublicationDay(int day)
+{
+    return isPublicationDay(day);
+}
+
+time_t CurrencyConverter::LastPublicationTime(time_t now, const PublicationPolicy &policy)
+{
+    return lastPublicationTime(now, policy);
+}
+
+time_t CurrencyConverter::NextPublicationTime(time_t now, const PublicationPolicy &policy)
+{
+    return nextPublicationTime(now, policy);
+}
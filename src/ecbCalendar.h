@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_ECB_CALENDAR_H
+#define CC_ECB_CALENDAR_H
+
+#include <time.h>
+
+namespace CurrencyConverter {
+
+//
+// When ECB publishes reference rates: around 16:00 CET on TARGET (the
+// euro payment system) business days. TARGET closes on week-ends, New
+// Year's Day, Good Friday, Easter Monday, 1 May, 25 and 26 December.
+// Closing days are precomputed for TARGET_FIRST_YEAR to TARGET_LAST_YEAR,
+// so whether new rates can exist is known without asking ECB.
+//
+static const int TARGET_FIRST_YEAR = 2002;
+static const int TARGET_LAST_YEAR = 2099;
+
+// Days since 1970-01-01 of a date of the proleptic Gregorian calendar
+// (H. Hinnant's days_from_civil)
+constexpr int CivilToDay(int year, int month, int mday)
+{
+	year -= month <= 2;
+	const int era = (year >= 0 ? year : year - 399) / 400;
+	const int yoe = year - era * 400;
+	const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+	const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// Day of Easter Sunday (anonymous Gregorian algorithm)
+constexpr int EasterSunday(int year)
+{
+	const int a = year % 19, b = year / 100, c = year % 100;
+	const int d = b / 4, e = b % 4, f = (b + 8) / 25, g = (b - f + 1) / 3;
+	const int h = (19 * a + b - d - g + 15) % 30;
+	const int i = c / 4, k = c % 4;
+	const int l = (32 + 2 * e + 2 * i - h - k) % 7;
+	const int m = (a + 11 * h + 22 * l) / 451;
+	const int month = (h + l - 7 * m + 114) / 31;
+	const int mday = (h + l - 7 * m + 114) % 31 + 1;
+	return CivilToDay(year, month, mday);
+}
+
+// True if ECB publishes rates on day (days since 1970-01-01). Out of the
+// calendar years, on every weekday
+bool IsEcbPublicationDay(int day);
+
+// Rates of a publication day are expected from this UTC time of day on: a
+// bit later than ECB publishes them, to give it some slack
+struct PublicationPolicy {
+	int hour;
+	int minute;
+	int second;
+
+	constexpr int TimeOfDay() const { return hour * 3600 + minute * 60 + second; }
+};
+
+static constexpr PublicationPolicy ECB_PUBLICATION_POLICY = { 15, 30, 0 };
+
+// Expected time of the last publication at or before now, and of the
+// next one after now. Computed, never looked up
+time_t LastPublicationTime(time_t now, const PublicationPolicy &policy = ECB_PUBLICATION_POLICY);
+time_t NextPublicationTime(time_t now, const PublicationPolicy &policy = ECB_PUBLICATION_POLICY);
+
+} // namespace CurrencyConverter
+
+#endif
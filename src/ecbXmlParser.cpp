@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ecbXmlParser.h"
+#include "utils.h"
+#include "lazyLibraries.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace CurrencyConverter;
+
+bool SnapshotXmlHandler::OnDate(const char *date)
+{
+#ifdef DEBUG
+    printf("Exchange rate date is %s\n", date);
+#endif
+    // ecbDateToTime expects exactly "YYYY-MM-DD"
+    if (strlen(date) != ECB_DATE_LEN || ecbDateToDay(date) < 0)
+        return false;
+
+    m_rates.SetDate( ecbDateToTime(date) );
+    return true;
+}
+
+void SnapshotXmlHandler::OnRate(CurrencyId currency, double rate)
+{
+#ifdef DEBUG
+    printf("New Currency (%s) Value  (%.4f)\n", CurrencyCode(currency), rate);
+#endif
+    m_rates.SetRate(currency, rate);
+}
+
+EcbXmlParser::EcbXmlParser(EcbXmlHandler &handler)
+    : m_handler(handler), m_xml(Xml()), m_ctxt(NULL), m_numRates(0), m_failed(false)
+{
+    if (!m_xml) {
+        m_failed = true;
+        return;
+    }
+
+    xmlSAXHandler sax;
+    memset(&sax, 0, sizeof(sax));
+    sax.initialized = XML_SAX2_MAGIC;
+    sax.startElementNs = startElement;
+
+    m_ctxt = m_xml->createPushParserCtxt(&sax, this, NULL, 0, NULL);
+    if (m_ctxt)
+        m_xml->ctxtUseOptions(m_ctxt, XML_PARSE_NONET | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+    else
+        m_failed = true;
+}
+
+EcbXmlParser::~EcbXmlParser()
+{
+    if (m_ctxt)
+        m_xml->freeParserCtxt(m_ctxt);
+}
+
+#define VALUE_MAX_LEN   32
+
+static const size_t FILE_CHUNK_SIZE = 64 * 1024;
+
+// SAX2 attribute values are not NUL terminated: copy them in a bounded buffer
+static bool _attributeValue(const unsigned char **attribute, char *value)
+{
+    size_t len = attribute[4] - attribute[3];
+    if (len >= VALUE_MAX_LEN)
+        return false;
+
+    memcpy(value, attribute[3], len);
+    value[len] = '\0';
+    return true;
+}
+
+#define ATTR_NAME_IS(A)  !strcmp( (const char *)attributes[i], A)
+void EcbXmlParser::startElement(void *ctx, const unsigned char *, const unsigned char *,
+    const unsigned char *, int, const unsigned char **,
+    int nb_attributes, int, const unsigned char **attributes)
+{
+    // Only "Cube" elements carry attributes in ECB documents:
+    //  <Cube time="YYYY-MM-DD"> opens a day
+    //  <Cube currency="XXX" rate="1.2345"/> is a rate for that day
+    EcbXmlParser *parser = (EcbXmlParser *) ctx;
+    if (parser->m_failed)
+        return;
+
+    char value[VALUE_MAX_LEN];
+    CurrencyId currency = INVALID_CURRENCY;
+    double rate = -1;
+    bool hasCurrency = false;
+
+    for (int i = 0; i < nb_attributes * 5; i += 5) {
+        if (!_attributeValue(attributes + i, value))
+            continue;
+
+        if ( ATTR_NAME_IS("currency") ) {
+            currency = CurrencyIdFromCode(value, strlen(value));
+            hasCurrency = true;
+        } else if ( ATTR_NAME_IS("rate") ) {
+            rate = strtod(value, NULL);
+        } else if ( ATTR_NAME_IS("time") ) {
+            if (!parser->m_handler.OnDate(value)) {
+                parser->m_failed = true;
+                return;
+            }
+        }
+    }
+
+    // Currencies unknown to us are skipped, not treated as errors
+    if (hasCurrency && currency != INVALID_CURRENCY && rate > 0) {
+        parser->m_handler.OnRate(currency, rate);
+        parser->m_numRates++;
+    }
+}
+
+int EcbXmlParser::Feed(const char *data, size_t len)
+{
+    if (m_failed)
+        return -1;
+
+    if (m_xml->parseChunk(m_ctxt, data, (int) len, 0) != 0)
+        m_failed = true;
+
+    return m_failed ? -1 : 0;
+}
+
+int EcbXmlParser::FeedFile(const std::string &fileName)
+{
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // Stream the file through the parser: memory use does not depend on its size
+    std::vector<char> chunk(FILE_CHUNK_SIZE);
+    ssize_t len;
+    int ret = 0;
+    while ((len = read(fd, chunk.data(), chunk.size())) > 0) {
+        if (Feed(chunk.data(), len) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    close(fd);
+
+    return (len < 0) ? -1 : ret;
+}
+
+int EcbXmlParser::Finish()
+{
+    if (m_failed)
+        return -1;
+
+    if (m_xml->parseChunk(m_ctxt, NULL, 0, 1) != 0 || !m_ctxt->wellFormed)
+        m_failed = true;
+
+    return (m_failed || m_numRates == 0) ? -1 : 0;
+}
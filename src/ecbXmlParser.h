@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_ECB_XML_PARSER_H
+#define CC_ECB_XML_PARSER_H
+
+#include "rateSnapshot.h"
+#include <stddef.h>
+#include <string>
+
+typedef struct _xmlParserCtxt *xmlParserCtxtPtr;
+
+namespace CurrencyConverter {
+
+struct XmlLibrary;
+
+//
+// Receives what the parser finds in an ECB reference rates document:
+// a date cube, then the rates published for that date.
+//
+class EcbXmlHandler {
+public:
+	virtual ~EcbXmlHandler() {}
+	// date is the NUL terminated time attribute of a cube, "YYYY-MM-DD" in
+	// well formed documents. Returns false to fail the document
+	virtual bool OnDate(const char *date) = 0;
+	virtual void OnRate(CurrencyId currency, double rate) = 0;
+};
+
+// Fills a snapshot from a single day document (eurofxref-daily.xml)
+class SnapshotXmlHandler : public EcbXmlHandler {
+public:
+	explicit SnapshotXmlHandler(RateSnapshot &rates) : m_rates(rates) {}
+	bool OnDate(const char *date);
+	void OnRate(CurrencyId currency, double rate);
+
+private:
+	RateSnapshot &m_rates;
+};
+
+//
+// Incremental (SAX push) parser of ECB reference rates documents.
+// Bytes are fed as they are received, so parsing overlaps the download,
+// and no document tree is ever built: memory use does not depend on the
+// document size.
+//
+class EcbXmlParser {
+public:
+	explicit EcbXmlParser(EcbXmlHandler &handler);
+	~EcbXmlParser();
+
+	// Parses the next chunk of the document. Returns -1 on parse error
+	int Feed(const char *data, size_t len);
+	// Feeds the whole content of a file. Returns -1 on read or parse error
+	int FeedFile(const std::string &fileName);
+	// Signals the end of the document. Returns 0 if it was well formed
+	// and had at least one rate, -1 otherwise
+	int Finish();
+
+private:
+	EcbXmlParser(const EcbXmlParser &);
+	EcbXmlParser& operator=(const EcbXmlParser &);
+
+	static void startElement(void *ctx, const unsigned char *localname, const unsigned char *prefix,
+		const unsigned char *URI, int nb_namespaces, const unsigned char **namespaces,
+		int nb_attributes, int nb_defaulted, const unsigned char **attributes);
+
+	EcbXmlHandler &m_handler;
+	const XmlLibrary *m_xml;
+	xmlParserCtxtPtr m_ctxt;
+	size_t m_numRates;
+	bool m_failed;
+};
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fixedRates.h"
+#include <math.h>
+
+using namespace CurrencyConverter;
+
+typedef unsigned __int128 uint128_t;
+
+// Largest rate scale: rates are far below 10^7 against EUR
+static const double MAX_SCALE = 1e18;
+
+static const uint64_t POWERS_OF_TEN[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+FixedRates::FixedRates()
+{
+    Clear();
+}
+
+void FixedRates::Clear()
+{
+    for (size_t i = 0; i < MAX_CURRENCIES; i++) {
+        m_scales[i] = 0;
+        m_reciprocals[i] = 0;
+        m_shifts[i] = 0;
+    }
+}
+
+void FixedRates::Build(const double *rates)
+{
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        double scale = rates[id] * POWERS_OF_TEN[RATE_DECIMALS] * POWERS_OF_TEN[CurrencyMinorUnits(id)];
+        if (rates[id] <= 0 || scale >= MAX_SCALE) {
+            m_scales[id] = 0;
+            continue;
+        }
+
+        // Rates are parsed from decimal text: rounding gives back the
+        // published digits exactly
+        m_scales[id] = (uint64_t) llround(scale);
+        if (m_scales[id] == 0)
+            continue;
+
+        m_shifts[id] = 63 - __builtin_clzll(m_scales[id]);
+        m_reciprocals[id] = (uint64_t) ((((uint128_t) 1 << (64 + m_shifts[id])) - 1) / m_scales[id]);
+    }
+}
+
+// Rounds magnitude * num / den half to even, den being described by its
+// reciprocal and shift. Returns false if the result does not fit 63 bits.
+//
+// The quotient estimate x * reciprocal >> (64 + shift) is never above the
+// exact one, and below it by less than (q + 1) * den / 2^(64 + shift) <= 1
+// for q < 2^63: a single correction step is enough.
+static inline bool _mulDivRounded(uint64_t magnitude, uint64_t num, uint64_t den,
+    uint64_t reciprocal, unsigned shift, uint64_t *result)
+{
+    uint128_t x = (uint128_t) magnitude * num;
+
+    uint128_t high = (uint128_t) (uint64_t) (x >> 64) * reciprocal;
+    uint128_t low = (uint128_t) (uint64_t) x * reciprocal;
+    uint128_t estimate = (high + (low >> 64)) >> shift;
+    if (estimate >> 63)
+        return false;
+
+    uint64_t q = (uint64_t) estimate;
+    uint128_t r = x - (uint128_t) q * den;
+    bool carry = r >= den;
+    q += carry;
+    r -= carry ? den : 0;
+
+    // Half to even, on the exact remainder
+    uint128_t twice = r << 1;
+    q += (twice > den) | ((twice == den) & (q & 1));
+
+    *result = q;
+    return (q >> 63) == 0;
+}
+
+int FixedRates::Convert(MinorUnits amount, CurrencyId from, CurrencyId to, MinorUnits *out) const
+{
+    if (!HasRate(from) || !HasRate(to))
+        return -1;
+
+    // Rounding half to even is symmetric: convert the magnitude
+    uint64_t magnitude = (amount < 0) ? -(uint64_t) amount : amount;
+    uint64_t result;
+    if (!_mulDivRounded(magnitude, m_scales[to], m_scales[from], m_reciprocals[from], m_shifts[from], &result))
+        return -1;
+
+    *out = (amount < 0) ? -(MinorUnits) result : (MinorUnits) result;
+    return 0;
+}
+
+int FixedRates::ConvertMany(const MinorUnits *amounts, MinorUnits *out, size_t count,
+    CurrencyId from, CurrencyId to) const
+{
+    if (!HasRate(from) || !HasRate(to))
+        return -1;
+
+    // One pair: num / den becomes a fixed point multiplier, integer part
+    // plus a 64 bits fraction, at the price of one division per batch.
+    // Truncating the fraction puts the estimate below the exact quotient
+    // by less than magnitude / 2^64 < 1
+    const uint64_t num = m_scales[to];
+    const uint64_t den = m_scales[from];
+    const uint64_t integer = num / den;
+    const uint64_t fraction = (uint64_t) (((uint128_t) (num % den) << 64) / den);
+    uint64_t overflow = 0;
+
+    // Branch free body. The remainder is below 2 * den < 2^64: it is computed
+    // exactly with wrapping 64 bits multiplies
+    for (size_t i = 0; i < count; i++) {
+        MinorUnits amount = amounts[i];
+        uint64_t sign = (uint64_t) (amount >> 63);
+        uint64_t magnitude = ((uint64_t) amount ^ sign) - sign;
+
+        uint64_t q;
+        overflow |= __builtin_mul_overflow(magnitude, integer, &q);
+        overflow |= __builtin_add_overflow(q, (uint64_t) (((uint128_t) magnitude * fraction) >> 64), &q);
+
+        uint64_t r = magnitude * num - q * den;
+        uint64_t carry = r >= den;
+        q += carry;
+        r -= carry * den;
+        q += (2 * r > den) | ((2 * r == den) & q);
+
+        overflow |= q >> 63;
+        out[i] = (MinorUnits) ((q ^ sign) - sign);
+    }
+
+    return overflow ? -1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_FIXED_RATES_H
+#define CC_FIXED_RATES_H
+
+#include "currency.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace CurrencyConverter {
+
+// Money amount in minor units of its currency (cents, yen...)
+typedef int64_t MinorUnits;
+
+// ECB publishes rates with at most 6 decimals
+static const unsigned RATE_DECIMALS = 6;
+
+//
+// Fixed point conversion engine: exact integer conversions between minor
+// units, rounded half to even, so results need no further rounding.
+//
+// A rate becomes the integer scale = rate * 10^RATE_DECIMALS * 10^minor units,
+// and a conversion is amount * scale[to] / scale[from], computed on 128 bits.
+// The division is replaced by a multiply by the reciprocal of scale[from],
+// precomputed once per snapshot; the remainder, recomputed exactly, fixes
+// the quotient and drives the rounding.
+//
+class FixedRates {
+public:
+	FixedRates();
+	void Clear();
+	// Scales rates against EUR, indexed by currency ID, negative when not available
+	void Build(const double *rates);
+
+	bool HasRate(CurrencyId id) const { return id < MAX_CURRENCIES && m_scales[id] != 0; }
+
+	// Converts amount, in minor units of from, into minor units of to.
+	// Returns -1 if a currency is not available or the result overflows
+	int Convert(MinorUnits amount, CurrencyId from, CurrencyId to, MinorUnits *out) const;
+	// Same for count amounts of one currency pair. Returns -1 if the pair
+	// is not available or any result overflows
+	int ConvertMany(const MinorUnits *amounts, MinorUnits *out, size_t count,
+		CurrencyId from, CurrencyId to) const;
+
+private:
+	uint64_t m_scales[MAX_CURRENCIES];		// 0 when not available
+	uint64_t m_reciprocals[MAX_CURRENCIES];	// (2^(64 + shift) - 1) / scale
+	uint8_t m_shifts[MAX_CURRENCIES];		// floor(log2(scale))
+};
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "lazyLibraries.h"
+#include <dlfcn.h>
+#include <iostream>
+#include <mutex>
+
+using namespace CurrencyConverter;
+
+// Runtime names, most common first
+static const char *CURL_SONAMES[] = { "libcurl.so.4", "libcurl-gnutls.so.4", "libcurl.so" };
+static const char *XML_SONAMES[] = { "libxml2.so.2", "libxml2.so.16", "libxml2.so" };
+
+static void *_open(const char **sonames, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        void *handle = dlopen(sonames[i], RTLD_NOW | RTLD_LOCAL);
+        if (handle)
+            return handle;
+    }
+
+    std::cerr << "ERROR: Failed to load " << sonames[0] << ": " << dlerror() << '\n';
+    return NULL;
+}
+
+// Resolves name into *function. Returns false if it is missing
+template <typename T>
+static bool _resolve(void *handle, const char *name, T *function)
+{
+    *function = (T) dlsym(handle, name);
+    if (!*function)
+        std::cerr << "ERROR: Missing symbol " << name << '\n';
+    return *function != NULL;
+}
+
+static std::once_flag _curlOnce;
+static CurlLibrary _curl;
+static bool _curlLoaded = false;
+
+static void _loadCurl()
+{
+    void *handle = _open(CURL_SONAMES, sizeof(CURL_SONAMES) / sizeof(CURL_SONAMES[0]));
+    if (!handle)
+        return;
+
+    decltype(&curl_global_init) globalInit;
+    bool ok = _resolve(handle, "curl_global_init", &globalInit)
+        && _resolve(handle, "curl_easy_init", &_curl.easy_init)
+        && _resolve(handle, "curl_easy_setopt", &_curl.easy_setopt)
+        && _resolve(handle, "curl_easy_perform", &_curl.easy_perform)
+        && _resolve(handle, "curl_easy_cleanup", &_curl.easy_cleanup)
+        && _resolve(handle, "curl_easy_strerror", &_curl.easy_strerror)
+        && _resolve(handle, "curl_easy_getinfo", &_curl.easy_getinfo)
+        && _resolve(handle, "curl_slist_append", &_curl.slist_append)
+        && _resolve(handle, "curl_slist_free_all", &_curl.slist_free_all)
+        && _resolve(handle, "curl_multi_init", &_curl.multi_init)
+        && _resolve(handle, "curl_multi_add_handle", &_curl.multi_add_handle)
+        && _resolve(handle, "curl_multi_remove_handle", &_curl.multi_remove_handle)
+        && _resolve(handle, "curl_multi_perform", &_curl.multi_perform)
+        && _resolve(handle, "curl_multi_wait", &_curl.multi_wait)
+        && _resolve(handle, "curl_multi_info_read", &_curl.multi_info_read)
+        && _resolve(handle, "curl_multi_cleanup", &_curl.multi_cleanup);
+
+    // Not thread safe: done once, under the once flag
+    if (ok && globalInit(CURL_GLOBAL_DEFAULT) == CURLE_OK)
+        _curlLoaded = true;
+}
+
+const CurlLibrary *CurrencyConverter::Curl()
+{
+    std::call_once(_curlOnce, _loadCurl);
+    return _curlLoaded ? &_curl : NULL;
+}
+
+static std::once_flag _xmlOnce;
+static XmlLibrary _xml;
+static bool _xmlLoaded = false;
+
+static void _loadXml()
+{
+    void *handle = _open(XML_SONAMES, sizeof(XML_SONAMES) / sizeof(XML_SONAMES[0]));
+    if (!handle)
+        return;
+
+    _xmlLoaded = _resolve(handle, "xmlCreatePushParserCtxt", &_xml.createPushParserCtxt)
+        && _resolve(handle, "xmlCtxtUseOptions", &_xml.ctxtUseOptions)
+        && _resolve(handle, "xmlParseChunk", &_xml.parseChunk)
+        && _resolve(handle, "xmlFreeParserCtxt", &_xml.freeParserCtxt);
+}
+
+const XmlLibrary *CurrencyConverter::Xml()
+{
+    std::call_once(_xmlOnce, _loadXml);
+    return _xmlLoaded ? &_xml : NULL;
+}
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_LAZY_LIBRARIES_H
+#define CC_LAZY_LIBRARIES_H
+
+#include <curl/curl.h>
+#include <libxml/parser.h>
+
+namespace CurrencyConverter {
+
+//
+// libcurl and libxml2 are only needed to download and parse ECB documents,
+// which most runs never do: a fresh rates cache is enough. Linking them
+// would make every exec load them, with their own dependencies (TLS, IDN,
+// compression, ICU...: about 35 libraries). They are loaded with dlopen
+// on first use instead; only their headers are used at build time.
+//
+
+// The libcurl functions in use
+struct CurlLibrary {
+	decltype(&curl_easy_init) easy_init;
+	decltype(&curl_easy_setopt) easy_setopt;
+	decltype(&curl_easy_perform) easy_perform;
+	decltype(&curl_easy_cleanup) easy_cleanup;
+	decltype(&curl_easy_strerror) easy_strerror;
+	decltype(&curl_easy_getinfo) easy_getinfo;
+	decltype(&curl_slist_append) slist_append;
+	decltype(&curl_slist_free_all) slist_free_all;
+	decltype(&curl_multi_init) multi_init;
+	decltype(&curl_multi_add_handle) multi_add_handle;
+	decltype(&curl_multi_remove_handle) multi_remove_handle;
+	decltype(&curl_multi_perform) multi_perform;
+	decltype(&curl_multi_wait) multi_wait;
+	decltype(&curl_multi_info_read) multi_info_read;
+	decltype(&curl_multi_cleanup) multi_cleanup;
+};
+
+// The libxml2 functions in use
+struct XmlLibrary {
+	decltype(&xmlCreatePushParserCtxt) createPushParserCtxt;
+	decltype(&xmlCtxtUseOptions) ctxtUseOptions;
+	decltype(&xmlParseChunk) parseChunk;
+	decltype(&xmlFreeParserCtxt) freeParserCtxt;
+};
+
+// Load the library on first call, from any thread, and return its
+// functions: NULL if it is not installed. libcurl is globally initialized
+// once loaded, and stays so until exit.
+const CurlLibrary *Curl();
+const XmlLibrary *Xml();
+
+} // namespace CurrencyConverter
+
+#endif
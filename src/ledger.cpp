@@ -0,0 +1,336 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ledger.h"
+#include "convertKernels.h"
+#include <charconv>
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <math.h>
+#include <mutex>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace CurrencyConverter;
+
+static const size_t CHUNK_SIZE = 4 << 20;
+// Records parsed, then converted with one kernel call
+static const size_t BATCH_SIZE = 1024;
+// Chunks being converted or waiting to be written, per thread
+static const size_t CHUNKS_IN_FLIGHT_PER_THREAD = 2;
+
+static const char ERROR_FIELD[] = ",ERROR";
+
+namespace {
+
+struct Chunk {
+    const char *begin;
+    const char *end;
+    std::string out;
+    long errors;
+    bool done;
+};
+
+class LedgerJob {
+public:
+    LedgerJob(const RateSnapshot &rates, std::vector<Chunk> &chunks, size_t maxInFlight)
+        : m_rates(rates), m_chunks(chunks), m_maxInFlight(maxInFlight), m_next(0), m_written(0) {}
+
+    void Work();
+    // Writes chunks in order as they are converted. Returns the number of
+    // errors, -1 if writing failed
+    long WriteAll(int fd);
+
+private:
+    void convert(Chunk &chunk);
+
+    const RateSnapshot &m_rates;
+    std::vector<Chunk> &m_chunks;
+    size_t m_maxInFlight;
+    size_t m_next;      // Next chunk to convert
+    size_t m_written;   // Chunks written so far
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+};
+
+} // namespace
+
+static const char *_skipSpaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// Parses a currency code field ending at delimiter (or at end), spaces around allowed
+static CurrencyId _parseCode(const char *&p, const char *end, char delimiter)
+{
+    p = _skipSpaces(p, end);
+    const char *code = p;
+    while (p < end && *p != delimiter && *p != ' ' && *p != '\t')
+        p++;
+    size_t len = p - code;
+    p = _skipSpaces(p, end);
+    return LookupCurrency(code, len);
+}
+
+// Parses "<amount>,<from>,<to>" between line and end (no line feed)
+static bool _parseRecord(const char *line, const char *end, double *amount, CurrencyId *from, CurrencyId *to)
+{
+    const char *p = _skipSpaces(line, end);
+    std::from_chars_result res = std::from_chars(p, end, *amount);
+    if (res.ec != std::errc() || !isfinite(*amount))
+        return false;
+
+    p = _skipSpaces(res.ptr, end);
+    if (p == end || *p++ != ',')
+        return false;
+
+    *from = _parseCode(p, end, ',');
+    if (p == end || *p++ != ',')
+        return false;
+
+    *to = _parseCode(p, end, ',');
+    return p == end;
+}
+
+void LedgerJob::convert(Chunk &chunk)
+{
+    // Output lines are the input ones plus a converted amount field
+    chunk.out.reserve((chunk.end - chunk.begin) + (chunk.end - chunk.begin) / 2);
+    chunk.errors = 0;
+
+    const char *lines[BATCH_SIZE];
+    const char *ends[BATCH_SIZE];
+    double amounts[BATCH_SIZE];
+    CurrencyId from[BATCH_SIZE];
+    CurrencyId to[BATCH_SIZE];
+    double converted[BATCH_SIZE];
+
+    const char *p = chunk.begin;
+    while (p < chunk.end) {
+        size_t n = 0;
+        for (; n < BATCH_SIZE && p < chunk.end; n++) {
+            const char *eol = (const char *) memchr(p, '\n', chunk.end - p);
+            if (!eol)
+                eol = chunk.end;
+            const char *end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+            lines[n] = p;
+            ends[n] = end;
+            if (!_parseRecord(p, end, &amounts[n], &from[n], &to[n])) {
+                // Converted to -1 by the kernel
+                amounts[n] = -1;
+                from[n] = to[n] = INVALID_CURRENCY;
+            }
+            p = eol + 1;
+        }
+
+        Kernels::GatherMultiply(amounts, from, to, m_rates.CrossRates(), converted, n);
+
+        for (size_t i = 0; i < n; i++) {
+            // Blank lines are kept as they are
+            if (_skipSpaces(lines[i], ends[i]) == ends[i]) {
+                chunk.out.append(lines[i], ends[i] - lines[i]);
+                chunk.out += '\n';
+                continue;
+            }
+
+            chunk.out.append(lines[i], ends[i] - lines[i]);
+            char field[64];
+            field[0] = ',';
+            std::to_chars_result res = { field, std::errc::invalid_argument };
+            if (converted[i] >= 0)
+                res = std::to_chars(field + 1, field + sizeof(field), converted[i], std::chars_format::fixed, 2);
+
+            // No rate, or too large to be written in fixed notation
+            if (res.ec != std::errc()) {
+                chunk.out.append(ERROR_FIELD, sizeof(ERROR_FIELD) - 1);
+                chunk.errors++;
+            } else {
+                chunk.out.append(field, res.ptr - field);
+            }
+            chunk.out += '\n';
+        }
+    }
+}
+
+void LedgerJob::Work()
+{
+    for (;;) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cond.wait(lock, [this] {
+                return m_next == m_chunks.size() || m_next < m_written + m_maxInFlight;
+            });
+            if (m_next == m_chunks.size())
+                return;
+            index = m_next++;
+        }
+
+        convert(m_chunks[index]);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_chunks[index].done = true;
+        m_cond.notify_all();
+    }
+}
+
+static bool _writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+long LedgerJob::WriteAll(int fd)
+{
+    long errors = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i < m_chunks.size(); i++) {
+        std::string out;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cond.wait(lock, [this, i] { return m_chunks[i].done; });
+            out.swap(m_chunks[i].out);
+        }
+
+        // Keep draining on failure: workers wait for room in the window
+        ok = ok && _writeAll(fd, out.data(), out.size());
+        errors += m_chunks[i].errors;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_written++;
+        m_cond.notify_all();
+    }
+
+    return ok ? errors : -1;
+}
+
+// Splits data in chunks of about CHUNK_SIZE bytes, on line boundaries
+static void _splitChunks(const char *data, size_t len, std::vector<Chunk> &chunks)
+{
+    const char *p = data;
+    const char *end = data + len;
+
+    while (p < end) {
+        const char *chunkEnd = p + CHUNK_SIZE;
+        if (chunkEnd >= end) {
+            chunkEnd = end;
+        } else {
+            const char *eol = (const char *) memchr(chunkEnd, '\n', end - chunkEnd);
+            chunkEnd = eol ? eol + 1 : end;
+        }
+
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end = chunkEnd;
+        chunk.errors = 0;
+        chunk.done = false;
+        chunks.push_back(chunk);
+        p = chunkEnd;
+    }
+}
+
+long CurrencyConverter::ConvertLedgerFile(const RateSnapshot &rates, const std::string &inFileName,
+    const std::string &outFileName, unsigned numThreads)
+{
+    int inFd = open(inFileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (inFd < 0) {
+        std::cerr << "ERROR: Failed to open " << inFileName << ": " << strerror(errno) << '\n';
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(inFd, &st) < 0) {
+        close(inFd);
+        return -1;
+    }
+
+    size_t len = st.st_size;
+    void *map = NULL;
+    if (len > 0) {
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, inFd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "ERROR: Failed to map " << inFileName << ": " << strerror(errno) << '\n';
+            close(inFd);
+            return -1;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+    }
+    close(inFd);
+
+    // Truncating it would pull the mapped input from under the workers
+    struct stat outSt;
+    if (stat(outFileName.c_str(), &outSt) == 0 && outSt.st_dev == st.st_dev && outSt.st_ino == st.st_ino) {
+        std::cerr << "ERROR: " << outFileName << " is the ledger being converted\n";
+        if (map)
+            munmap(map, len);
+        return -1;
+    }
+
+    int outFd = open(outFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (outFd < 0) {
+        std::cerr << "ERROR: Failed to create " << outFileName << ": " << strerror(errno) << '\n';
+        if (map)
+            munmap(map, len);
+        return -1;
+    }
+
+    std::vector<Chunk> chunks;
+    _splitChunks((const char *) map, len, chunks);
+
+    if (numThreads == 0)
+        numThreads = 1;
+    LedgerJob job(rates, chunks, numThreads * CHUNKS_IN_FLIGHT_PER_THREAD);
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < numThreads; i++)
+        workers.push_back(std::thread(&LedgerJob::Work, &job));
+
+    long errors = job.WriteAll(outFd);
+
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    if (close(outFd) < 0)
+        errors = -1;
+    if (errors < 0)
+        std::cerr << "ERROR: Failed to write " << outFileName << '\n';
+
+    if (map)
+        munmap(map, len);
+    return errors;
+}
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_LEDGER_H
+#define CC_LEDGER_H
+
+#include "rateSnapshot.h"
+#include <string>
+
+namespace CurrencyConverter {
+
+//
+// Bulk conversion of CSV ledgers: every "<amount>,<from>,<to>" line of the
+// input is written to the output with the converted amount appended, or
+// ERROR for lines that can't be parsed or converted:
+//	1250.00,USD,JPY  ->  1250.00,USD,JPY,203062.50
+//
+// The input is mapped and split in chunks on line boundaries, converted by
+// a pool of threads against one snapshot, and the chunk outputs are written
+// in input order as soon as they are ready. The number of chunks in flight
+// is bounded, so memory use does not depend on the ledger size.
+//
+// Returns the number of lines that could not be converted, -1 if the
+// input can't be read or the output written.
+long ConvertLedgerFile(const RateSnapshot &rates, const std::string &inFileName,
+	const std::string &outFileName, unsigned numThreads);
+
+} // namespace CurrencyConverter
+
+#endif
@@ -17,20 +17,24 @@
  *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include "rateManager.h"
+#include "currencyconverter.h"
+#include "converterHandle.h"
+#include "utils.h"
+#include "daemon.h"
+#include "metrics.h"
 #include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <cmath>
+#include <cstring>
 #include <ctime>
 
-static const int NUM_OF_ARGS_VERSION_HELP	= 2;
-static const int NUM_OF_ARGS_CONVERSION		= 7;
-
 void print_details()
 {
 	std::cout <<
-		"CurrencyConverter " \
-		VERSION \
+		"CurrencyConverter " << cc_version() <<
 		" - " \
 		"Copyright (c) 2019 Gilles Talis \n";
 }
@@ -40,40 +44,349 @@ void usage()
 	std::cout <<
 		"Usage: \n" \
 		"  currencyconverter [options]\n" \
-		"  currencyconverter -a <amount> -f <currency> -t <currency>\n\n" \
+		"  currencyconverter -a <amount> -f <currency> -t <currency>\n" \
+		"  currencyconverter -a <amount> -f <currency> --all\n" \
+		"  currencyconverter -a <amount> -f <currency> -t <currency> -d <YYYY-MM-DD>\n\n" \
 		"Performs currency conversion based on European Central Bank reference rates \n\n" \
 		"Options: \n" \
 		"-h 		Displays this help message\n" \
 		"-v 		Displays tool version\n" \
 		"-t <currency>	Defines the currency to convert the amount to\n" \
 		"-f <currency>	Defines the currency to convert the amount from\n" \
-		"-a <amount>	Sets the amount to convert\n";
+		"-a <amount>	Sets the amount to convert\n" \
+		"--all		Converts the amount to every available currency\n" \
+		"-d <date>	Converts at the reference rates of a past date (YYYY-MM-DD)\n" \
+		"--import-history <file>\n" \
+		"		Imports a rates history (ECB eurofxref-hist.xml) from a file\n" \
+		"--fetch-history	Downloads the rates history from ECB\n" \
+		"--daemon	Serves conversions on a Unix domain socket\n" \
+		"--client	Performs conversions (single or --stream) through the daemon,\n" \
+		"		at its current rates: not with -d or --all\n" \
+		"--socket <path>	Sets the daemon socket path\n" \
+		"--stats		Prints pipeline latencies and counters (JSON) on stderr\n" \
+		"		on exit, and writes them in Prometheus text format to\n" \
+		"		currency_converter.prom (periodically in daemon mode)\n" \
+		"--ledger <file> --out <file>\n" \
+		"		Converts a CSV ledger of '<amount>,<from>,<to>' lines, appending\n" \
+		"		the converted amount (or ERROR) to each line\n" \
+		"--source <url|file|dir>\n" \
+		"		Gets rates from this source instead of ECB: an http(s)://\n" \
+		"		mirror, a file:// URL or path, or a directory where the most\n" \
+		"		recent *.xml is used. Repeat to race several sources\n" \
+		"--source-timeout <seconds>\n" \
+		"		Sets the download timeout of the following sources, up to\n" \
+		"		3600 seconds\n" \
+		"--quotes <file>	Adds rates quoted by other sources: '<base> <quote> <rate>'\n" \
+		"		lines, converted along with the ECB ones\n" \
+		"--shared-rates	Shares rates with the other processes of the user\n" \
+		"		through shared memory instead of each reading the cache\n" \
+		"--series <pair> [--from <date>] [--to <date>] [--window <days>]\n" \
+		"		Prints the moving average, minimum, maximum and annualized\n" \
+		"		volatility of a pair (EURUSD, or EUR/USD) over windows of\n" \
+		"		business days (20 by default), from the rates history\n" \
+		"--archive	Archives every rates downloaded and history imported or\n" \
+		"		fetched in currency_converter.archive\n" \
+		"--archive-dump [--from <date>] [--to <date>]\n" \
+		"		Prints the archived rates as CSV, a line per day\n" \
+		"--stream	Reads '<amount> <from> <to>' lines from stdin and writes\n" \
+		"		one converted amount per line to stdout\n";
 }
 
+static const int STREAM_LINE_MAX = 256;
 
-int main(int argc, char **argv)
+static void dump_stats()
+{
+	CurrencyConverter::Metrics::WriteJson(stderr);
+
+	std::string metricsFn = _getMetricsFileName();
+	if (CurrencyConverter::Metrics::WritePrometheusFile(metricsFn) < 0)
+		std::cerr << "ERROR: Failed to write metrics to " << metricsFn << '\n';
+}
+
+// Long running pipe mode: rates are resolved once, then every input record
+// is converted and answered on its own flushed line, so a coprocess can keep
+// the tool open instead of spawning it per conversion.
+int run_stream(cc_converter *converter)
+{
+	if (cc_load_rates(converter) != CC_OK) {
+		std::cerr << "ERROR: Failed to load exchange rates\n";
+		return EXIT_FAILURE;
+	}
+
+	char line[STREAM_LINE_MAX];
+	char from[STREAM_LINE_MAX];
+	char to[STREAM_LINE_MAX];
+	double amount;
+	double convertedAmount;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		// Skip blank lines, but keep one answer per record otherwise
+		if (line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+
+		if (sscanf(line, "%lf %255s %255s", &amount, from, to) == 3 &&
+			cc_convert(converter, amount, from, to, &convertedAmount) == CC_OK)
+			printf("%.2f\n", convertedAmount);
+		else
+			fputs("ERROR\n", stdout);
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+int run_ledger(CurrencyConverter::RateManager &rr, const char *ledgerFn, const char *outFn)
+{
+	long errors = rr.ConvertLedger(ledgerFn, outFn, 0);
+	if (errors < 0) {
+		std::cerr << "ERROR: Failed to convert ledger " << ledgerFn << '\n';
+		return EXIT_FAILURE;
+	}
+
+	if (errors > 0)
+		std::cerr << errors << " lines of " << ledgerFn << " could not be converted\n";
+	return 0;
+}
+
+static const long DEFAULT_SERIES_WINDOW = 20;
+
+int run_series(CurrencyConverter::RateManager &rr, const char *pair, const char *from, const char *to, long window)
+{
+	// "EURUSD" or "EUR/USD"
+	size_t len = strlen(pair);
+	size_t quoteStart = (len == 7 && pair[3] == '/') ? 4 : 3;
+	int fromDay = from ? ecbDateToDay(from) : 0;
+	int toDay = to ? ecbDateToDay(to) : time(NULL) / NUM_SECONDS_DAY;
+	if ((len != 6 && quoteStart != 4) || fromDay < 0 || toDay < 0 || window < 3) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	CurrencyConverter::WindowStats stats;
+	if (rr.ComputeWindowStats(std::string(pair, 3), std::string(pair + quoteStart, 3),
+		fromDay, toDay, window, stats) < 0) {
+		std::cerr << "ERROR: Failed to compute statistics of " << pair << '\n';
+		return EXIT_FAILURE;
+	}
+
+	printf("%-10s %12s %12s %12s %12s %10s\n", "date", "rate", "mean", "min", "max", "volatility");
+	char date[ECB_DATE_LEN + 1];
+	for (size_t i = 0; i < stats.days.size(); i++) {
+		dayToEcbDate(stats.days[i], date);
+		printf("%-10s %12.6f %12.6f %12.6f %12.6f %10.4f\n", date, stats.rates[i], stats.means[i],
+			stats.minimums[i], stats.maximums[i], stats.volatilities[i]);
+	}
+	return 0;
+}
+
+int run_archive_dump(CurrencyConverter::RateManager &rr, const char *from, const char *to)
+{
+	int fromDay = from ? ecbDateToDay(from) : 0;
+	int toDay = to ? ecbDateToDay(to) : time(NULL) / NUM_SECONDS_DAY;
+	if (fromDay < 0 || toDay < 0) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	CurrencyConverter::RateHistory history;
+	if (rr.LoadArchive(fromDay, toDay, history) < 0)
+		return EXIT_FAILURE;
+
+	const double *columns[CurrencyConverter::MAX_CURRENCIES];
+	size_t numColumns = 0;
+	fputs("date", stdout);
+	for (CurrencyConverter::CurrencyId id = 1; id < CurrencyConverter::MAX_CURRENCIES; id++) {
+		if (history.Column(id)) {
+			printf(",%s", CurrencyConverter::CurrencyCode(id));
+			columns[numColumns++] = history.Column(id);
+		}
+	}
+	putchar('\n');
+
+	char date[ECB_DATE_LEN + 1];
+	for (size_t i = 0; i < history.NumDays(); i++) {
+		dayToEcbDate(history.Days()[i], date);
+		fputs(date, stdout);
+		for (size_t column = 0; column < numColumns; column++) {
+			if (std::isnan(columns[column][i]))
+				putchar(',');
+			else
+				printf(",%.6f", columns[column][i]);
+		}
+		putchar('\n');
+	}
+	return 0;
+}
+
+static void print_last_update(cc_converter *converter)
+{
+	int64_t date;
+	if (cc_rates_date(converter, &date) != CC_OK)
+		return;
+
+	time_t update = date;
+	std::cout << "European Central Bank reference rates last update: UTC " << ctime ( &update );
+}
+
+int run_convert_to_all(cc_converter *converter, double amount, const std::string &fromCurrency)
+{
+	int fromId = cc_currency_id(fromCurrency.c_str());
+	double convertedAmounts[CC_MAX_CURRENCIES];
+
+	cc_status status = cc_convert_to_all(converter, amount, fromCurrency.c_str(), convertedAmounts);
+	if (status != CC_OK) {
+		std::cerr << "ERROR: Could not convert " << amount << " " << fromCurrency << ": " <<
+			cc_status_string(status) << '\n';
+		return 0;
+	}
+
+	for (int id = 0; id < CC_MAX_CURRENCIES; id++) {
+		if (id != fromId && !std::isnan(convertedAmounts[id]))
+			printf("%.2f %s = %.2f %s\n", amount, fromCurrency.c_str(), convertedAmounts[id], cc_currency_code(id));
+	}
+
+	print_last_update(converter);
+	return 0;
+}
+
+// The command line tool is a client of the library: conversions go through
+// its C API, the modes it does not cover through the C++ API under it
+static int run(cc_converter *converter, int argc, char **argv)
 {
-	CurrencyConverter::RateManager &rr = CurrencyConverter::RateManager::Instance();
+	CurrencyConverter::RateManager &rr = converter->rates;
 
 	std::string fromCurrency = {};
 	std::string toCurrency = {};
 	double amount = 0;
+	bool stream = false;
+	bool allCurrencies = false;
+	const char *date = NULL;
+	const char *historyFn = NULL;
+	bool fetchHistory = false;
+	bool daemon = false;
+	bool client = false;
+	bool stats = false;
+	const char *ledgerFn = NULL;
+	const char *outFn = NULL;
+	unsigned sourceTimeoutMs = CurrencyConverter::DEFAULT_SOURCE_TIMEOUT_MS;
+	const char *series = NULL;
+	const char *seriesFrom = NULL;
+	const char *seriesTo = NULL;
+	bool archiveDump = false;
+	long window = DEFAULT_SERIES_WINDOW;
+	std::string socketPath = _getSocketFileName();
 
-	// For now, we only accept:
-	// - one argument (help or version)
-	// - six arguments: sum, source currency, destination currency
-	if ( (argc != NUM_OF_ARGS_VERSION_HELP) // help / version
-		&& (argc != NUM_OF_ARGS_CONVERSION) // conversion
-		) {
+	if (argc < 2) {
 		usage();
 		return 0;
 	}
 
+	static const struct option long_options[] = {
+		{ "stream",	no_argument,	0,	's' },
+		{ "all",	no_argument,	0,	'A' },
+		{ "import-history",	required_argument,	0,	'I' },
+		{ "fetch-history",	no_argument,	0,	'F' },
+		{ "daemon",	no_argument,	0,	'D' },
+		{ "client",	no_argument,	0,	'C' },
+		{ "socket",	required_argument,	0,	'S' },
+		{ "stats",	no_argument,	0,	'M' },
+		{ "ledger",	required_argument,	0,	'L' },
+		{ "out",	required_argument,	0,	'O' },
+		{ "source",	required_argument,	0,	'R' },
+		{ "source-timeout",	required_argument,	0,	'T' },
+		{ "shared-rates",	no_argument,	0,	'H' },
+		{ "quotes",	required_argument,	0,	'Q' },
+		{ "series",	required_argument,	0,	'P' },
+		{ "from",	required_argument,	0,	'B' },
+		{ "to",	required_argument,	0,	'E' },
+		{ "window",	required_argument,	0,	'W' },
+		{ "archive",	no_argument,	0,	'X' },
+		{ "archive-dump",	no_argument,	0,	'U' },
+		{ 0,		0,		0,	0 }
+	};
+
 	int c ;
-	while( ( c = getopt (argc, argv, "f:t:a:vh") ) != -1 )
+	while( ( c = getopt_long (argc, argv, "f:t:a:d:vh", long_options, NULL) ) != -1 )
 	{
 		switch(c)
 		{
+			case 's':
+				stream = true;
+				break;
+			case 'A':
+				allCurrencies = true;
+				break;
+			case 'd':
+				date = optarg;
+				break;
+			case 'I':
+				historyFn = optarg;
+				break;
+			case 'F':
+				fetchHistory = true;
+				break;
+			case 'D':
+				daemon = true;
+				break;
+			case 'C':
+				client = true;
+				break;
+			case 'S':
+				socketPath = optarg;
+				break;
+			case 'M':
+				stats = true;
+				break;
+			case 'L':
+				ledgerFn = optarg;
+				break;
+			case 'O':
+				outFn = optarg;
+				break;
+			case 'R':
+				if (cc_add_source(converter, optarg, sourceTimeoutMs) != CC_OK) {
+					std::cerr << "ERROR: Unsupported rates source " << optarg << '\n';
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'T':
+			{
+				// Negated to also reject NaN
+				const double timeoutMs = std::ceil(std::atof(optarg) * 1000);
+				if (!(timeoutMs > 0 && timeoutMs <= CurrencyConverter::MAX_SOURCE_TIMEOUT_MS)) {
+					usage();
+					return EXIT_FAILURE;
+				}
+				sourceTimeoutMs = (unsigned) timeoutMs;
+				break;
+			}
+			case 'H':
+				if (rr.EnableSharedRates() < 0)
+					return EXIT_FAILURE;
+				break;
+			case 'Q':
+				if (cc_add_quotes(converter, optarg) != CC_OK)
+					return EXIT_FAILURE;
+				break;
+			case 'P':
+				series = optarg;
+				break;
+			case 'B':
+				seriesFrom = optarg;
+				break;
+			case 'E':
+				seriesTo = optarg;
+				break;
+			case 'W':
+				window = std::atol(optarg);
+				break;
+			case 'X':
+				if (rr.EnableArchive() < 0)
+					return EXIT_FAILURE;
+				break;
+			case 'U':
+				archiveDump = true;
+				break;
 			case 'f':
 				if(optarg) fromCurrency = optarg;
 				break;
@@ -98,13 +411,109 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (daemon)
+		return (CurrencyConverter::RunDaemon(rr, socketPath, stats ? _getMetricsFileName() : "") < 0) ? EXIT_FAILURE : 0;
+
+	// Every exit path below reports what was measured up to it
+	if (stats)
+		atexit(dump_stats);
+
+	if (ledgerFn || outFn) {
+		if (!ledgerFn || !outFn) {
+			usage();
+			return 0;
+		}
+		return run_ledger(rr, ledgerFn, outFn);
+	}
+
+	if (series)
+		return run_series(rr, series, seriesFrom, seriesTo, window);
+	if (archiveDump)
+		return run_archive_dump(rr, seriesFrom, seriesTo);
+
+	if (stream && client)
+		return (CurrencyConverter::RunClientStream(socketPath) < 0) ? EXIT_FAILURE : 0;
+	if (stream)
+		return run_stream(converter);
+
+	if (historyFn && rr.ImportHistory(historyFn) < 0)
+		return EXIT_FAILURE;
+	if (fetchHistory && rr.FetchHistory() < 0)
+		return EXIT_FAILURE;
+	if ((historyFn || fetchHistory) && fromCurrency.empty())
+		return 0;
+
+	// A conversion needs a source currency, and a destination one unless
+	// converting to all currencies
+	if (fromCurrency.empty() || (toCurrency.empty() && !allCurrencies)) {
+		usage();
+		return 0;
+	}
+
+	int day = -1;
+	if (date) {
+		day = ecbDateToDay(date);
+		if (day < 0 || allCurrencies) {
+			usage();
+			return 0;
+		}
+	}
+
+	// The daemon only converts single amounts at its current rates
+	if (client && (date || allCurrencies)) {
+		usage();
+		return 0;
+	}
+
 	print_details();
-	double convertedAmount = rr.Convert(amount, fromCurrency, toCurrency);
-	if (convertedAmount >= 0) {
-		time_t update = rr.GetRatesLastUpdatedDate();
+	if (allCurrencies)
+		return run_convert_to_all(converter, amount, fromCurrency);
+
+	if (client) {
+		double convertedAmount;
+		time_t update;
+		if (CurrencyConverter::DaemonConvert(socketPath, amount, fromCurrency, toCurrency,
+			&convertedAmount, &update) < 0) {
+			std::cerr << "ERROR: Daemon could not convert " << amount << " " << fromCurrency <<
+				" to " << toCurrency << '\n';
+			return 0;
+		}
 		printf("%.2f %s = %.2f %s\n", amount, fromCurrency.c_str(), convertedAmount, toCurrency.c_str());
 		std::cout << "European Central Bank reference rates last update: UTC " << ctime ( &update );
+		return 0;
+	}
+
+	if (day >= 0) {
+		double convertedAmount = rr.Convert(amount, fromCurrency, toCurrency, (time_t) day * NUM_SECONDS_DAY);
+		if (convertedAmount >= 0) {
+			printf("%.2f %s = %.2f %s\n", amount, fromCurrency.c_str(), convertedAmount, toCurrency.c_str());
+			std::cout << "European Central Bank reference rates as of " << date << '\n';
+		}
+		return 0;
+	}
+
+	double convertedAmount;
+	cc_status status = cc_convert(converter, amount, fromCurrency.c_str(), toCurrency.c_str(), &convertedAmount);
+	if (status != CC_OK) {
+		std::cerr << "ERROR: Could not convert " << amount << " " << fromCurrency << " to " <<
+			toCurrency << ": " << cc_status_string(status) << '\n';
+		return 0;
 	}
 
+	printf("%.2f %s = %.2f %s\n", amount, fromCurrency.c_str(), convertedAmount, toCurrency.c_str());
+	print_last_update(converter);
 	return 0;
 }
+
+int main(int argc, char **argv)
+{
+	cc_converter *converter;
+	if (cc_open(&converter) != CC_OK) {
+		std::cerr << "ERROR: Failed to create the converter\n";
+		return EXIT_FAILURE;
+	}
+
+	int ret = run(converter, argc, argv);
+	cc_close(converter);
+	return ret;
+}
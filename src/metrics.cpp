@@ -0,0 +1,223 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+#include "utils.h"
+#include <time.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+static const char *STAGE_NAMES[NUM_STAGES] = {
+    "up_to_date_check",
+    "cache_load",
+    "ecb_fetch",
+    "xml_parse",
+    "cache_store",
+    "convert",
+    "daemon_batch",
+};
+
+static const char *COUNTER_NAMES[NUM_COUNTERS] = {
+    "cache_hits",
+    "cache_misses",
+    "shared_rates_hits",
+    "ecb_fetches",
+    "ecb_fetch_failures",
+    "refresh_lease_waits",
+    "refresh_shared",
+    "ecb_not_modified",
+    "ecb_bytes_received",
+    "cache_store_failures",
+    "conversion_errors",
+    "daemon_requests",
+};
+
+static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+static const size_t NUM_QUANTILES = sizeof(QUANTILES) / sizeof(QUANTILES[0]);
+
+static LatencyHistogram _stages[NUM_STAGES];
+static std::atomic<uint64_t> _counters[NUM_COUNTERS];
+static uint64_t (*_allocationCount)() = nullptr;
+
+LatencyHistogram::LatencyHistogram()
+{
+    for (unsigned i = 0; i < NUM_BUCKETS; i++)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+unsigned LatencyHistogram::bucketIndex(uint64_t ns)
+{
+    // Values below SUB_BUCKETS have a bucket each, then every power of two
+    // is split into SUB_BUCKETS buckets
+    if (ns < SUB_BUCKETS)
+        return ns;
+
+    unsigned exponent = 63 - __builtin_clzll(ns);
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + ((ns >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(unsigned index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    unsigned shift = index / SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t) (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lower + ((uint64_t) 1 << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t ns)
+{
+    m_buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        ;
+}
+
+uint64_t LatencyHistogram::Count() const
+{
+    // Not maintained on its own: recording is one atomic add cheaper
+    uint64_t count = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; i++)
+        count += m_buckets[i].load(std::memory_order_relaxed);
+    return count;
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const
+{
+    // Buckets are read one by one while others may be recording: the
+    // result is approximate, like the buckets themselves
+    uint64_t count = Count();
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (q * count + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t bound = bucketUpperBound(i);
+            return (bound < Max()) ? bound : Max();
+        }
+    }
+
+    return Max();
+}
+
+uint64_t Metrics::Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void Metrics::Record(MetricsStage stage, uint64_t ns)
+{
+    _stages[stage].Record(ns);
+}
+
+void Metrics::Increment(MetricsCounter counter, uint64_t n)
+{
+    _counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+const LatencyHistogram &Metrics::Stage(MetricsStage stage)
+{
+    return _stages[stage];
+}
+
+uint64_t Metrics::Counter(MetricsCounter counter)
+{
+    return _counters[counter].load(std::memory_order_relaxed);
+}
+
+void Metrics::SetAllocationCounter(uint64_t (*allocationCount)())
+{
+    _allocationCount = allocationCount;
+}
+
+void Metrics::WriteJson(FILE *out)
+{
+    fprintf(out, "{\n\t\"stages\": {\n");
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        const LatencyHistogram &h = _stages[stage];
+        fprintf(out, "\t\t\"%s\": { \"count\": %llu, \"sum_ns\": %llu, \"max_ns\": %llu",
+            STAGE_NAMES[stage], (unsigned long long) h.Count(), (unsigned long long) h.Sum(),
+            (unsigned long long) h.Max());
+        for (size_t i = 0; i < NUM_QUANTILES; i++) {
+            fprintf(out, ", \"p%g_ns\": %llu", QUANTILES[i] * 100,
+                (unsigned long long) h.Quantile(QUANTILES[i]));
+        }
+        fprintf(out, " }%s\n", (stage + 1 < NUM_STAGES) ? "," : "");
+    }
+
+    fprintf(out, "\t},\n\t\"counters\": {\n");
+    for (int counter = 0; counter < NUM_COUNTERS; counter++) {
+        fprintf(out, "\t\t\"%s\": %llu%s\n", COUNTER_NAMES[counter],
+            (unsigned long long) Counter((MetricsCounter) counter),
+            (counter + 1 < NUM_COUNTERS || _allocationCount) ? "," : "");
+    }
+    if (_allocationCount)
+        fprintf(out, "\t\t\"heap_allocations\": %llu\n", (unsigned long long) _allocationCount());
+    fprintf(out, "\t}\n}\n");
+}
+
+static void _writePrometheus(FILE *out)
+{
+    // Stages are exported as summaries: the histogram buckets are too
+    // fine grained to be exported as they are
+    fprintf(out, "# HELP currencyconverter_stage_duration_seconds Latency of the rates pipeline stages\n");
+    fprintf(out, "# TYPE currencyconverter_stage_duration_seconds summary\n");
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        const LatencyHistogram &h = _stages[stage];
+        for (size_t i = 0; i < NUM_QUANTILES && h.Count() > 0; i++) {
+            fprintf(out, "currencyconverter_stage_duration_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                STAGE_NAMES[stage], QUANTILES[i], h.Quantile(QUANTILES[i]) / 1e9);
+        }
+        fprintf(out, "currencyconverter_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n",
+            STAGE_NAMES[stage], h.Sum() / 1e9);
+        fprintf(out, "currencyconverter_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+            STAGE_NAMES[stage], (unsigned long long) h.Count());
+    }
+
+    for (int counter = 0; counter < NUM_COUNTERS; counter++) {
+        fprintf(out, "# TYPE currencyconverter_%s_total counter\n", COUNTER_NAMES[counter]);
+        fprintf(out, "currencyconverter_%s_total %llu\n", COUNTER_NAMES[counter],
+            (unsigned long long) Metrics::Counter((MetricsCounter) counter));
+    }
+    if (_allocationCount) {
+        fprintf(out, "# TYPE currencyconverter_heap_allocations_total counter\n");
+        fprintf(out, "currencyconverter_heap_allocations_total %llu\n", (unsigned long long) _allocationCount());
+    }
+}
+
+int Metrics::WritePrometheusFile(const std::string &fileName)
+{
+    // The daemon and command line runs may write it at the same time
+    return _writeFileAtomically(fileName, _writePrometheus);
+}
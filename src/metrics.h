@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_METRICS_H
+#define CC_METRICS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+namespace CurrencyConverter {
+
+//
+// Always-on process metrics: latency histograms of the rates pipeline
+// stages and event counters. Recording is a few relaxed atomic updates,
+// without locks or allocations, so it may be done from any thread.
+//
+// The ID based and bulk conversion paths are not timed: reading the clock
+// would cost more than the conversion itself.
+//
+enum MetricsStage {
+	STAGE_UP_TO_DATE_CHECK,		// storedRatesUpToDate
+	STAGE_CACHE_LOAD,		// getStoredRates
+	STAGE_ECB_FETCH,		// getECBRates: download, parsing included
+	STAGE_XML_PARSE,		// ExtractRatesFromECBXml, or parsing during a download
+	STAGE_CACHE_STORE,		// storeECBRates
+	STAGE_CONVERT,			// Convert, by currency codes
+	STAGE_DAEMON_BATCH,		// Daemon requests received in one read
+	NUM_STAGES
+};
+
+enum MetricsCounter {
+	COUNTER_CACHE_HITS,		// Usable rates found in the local cache
+	COUNTER_CACHE_MISSES,		// Local cache missing, corrupted or outdated
+	COUNTER_SHARED_RATES_HITS,	// Up to date rates found in shared memory
+	COUNTER_ECB_FETCHES,
+	COUNTER_ECB_FETCH_FAILURES,
+	COUNTER_REFRESH_LEASE_WAITS,	// Another process was downloading rates
+	COUNTER_REFRESH_SHARED,		// ... and its rates were used: no download
+	COUNTER_ECB_NOT_MODIFIED,	// Fetches answered 304: cached rates are current
+	COUNTER_ECB_BYTES_RECEIVED,	// Downloaded bytes, as sent (compressed)
+	COUNTER_CACHE_STORE_FAILURES,
+	COUNTER_CONVERSION_ERRORS,	// Unknown currency, invalid amount or no rates
+	COUNTER_DAEMON_REQUESTS,
+	NUM_COUNTERS
+};
+
+//
+// HDR style latency histogram: values, in ns, are counted in buckets whose
+// width is 1/8 of their power of two, so any quantile is known within
+// 12.5% over the whole range, in a fixed 4 KB of counters.
+//
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void Record(uint64_t ns);
+	uint64_t Count() const;
+	uint64_t Sum() const { return m_sum.load(std::memory_order_relaxed); }
+	uint64_t Max() const { return m_max.load(std::memory_order_relaxed); }
+	// Upper bound of the bucket holding quantile q (0 < q <= 1), 0 if empty
+	uint64_t Quantile(double q) const;
+
+private:
+	static const unsigned SUB_BUCKET_BITS = 3;
+	static const unsigned SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const unsigned NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	static unsigned bucketIndex(uint64_t ns);
+	static uint64_t bucketUpperBound(unsigned index);
+
+	std::atomic<uint64_t> m_buckets[NUM_BUCKETS];
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_max;
+};
+
+namespace Metrics {
+
+// Monotonic clock, in ns
+uint64_t Now();
+
+void Record(MetricsStage stage, uint64_t ns);
+void Increment(MetricsCounter counter, uint64_t n = 1);
+
+const LatencyHistogram &Stage(MetricsStage stage);
+uint64_t Counter(MetricsCounter counter);
+
+// Source of the heap allocations count (see allocationCounter.h), reported
+// as the heap_allocations counter once set
+void SetAllocationCounter(uint64_t (*allocationCount)());
+
+// Dumps every stage and counter as a JSON document
+void WriteJson(FILE *out);
+// Writes the metrics in Prometheus text format. The file is replaced
+// atomically, so a collector never reads a partial one.
+// Returns 0 on success, -1 otherwise
+int WritePrometheusFile(const std::string &fileName);
+
+} // namespace Metrics
+
+// Times the enclosing scope into a stage histogram
+class StageTimer {
+public:
+	explicit StageTimer(MetricsStage stage) : m_stage(stage), m_start(Metrics::Now()) {}
+	~StageTimer() { Metrics::Record(m_stage, Metrics::Now() - m_start); }
+
+private:
+	StageTimer(const StageTimer &);
+	StageTimer& operator=(const StageTimer &);
+
+	MetricsStage m_stage;
+	uint64_t m_start;
+};
+
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,545 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rateArchive.h"
+#include "fixedRates.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+static const char RATE_ARCHIVE_MAGIC[8] = { 'C', 'C', 'A', 'R', 'C', 'H', '\0', '\0' };
+static const uint32_t RATE_ARCHIVE_VERSION = 1;
+static const double RATE_SCALE = 1e6;
+static_assert(RATE_DECIMALS == 6, "RATE_SCALE must match the rates precision");
+
+struct RateArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct ArchiveBlockHeader {
+    int32_t firstDay;
+    int32_t lastDay;
+    uint16_t numDays;
+    uint8_t numColumns;
+    uint8_t reserved;
+    uint32_t payloadSize;
+    uint32_t checksum;		// Of the payload, see _checksum()
+};
+
+static const char *PENDING_SUFFIX = ".pending";
+static const unsigned ARCHIVE_LOCK_WAIT_MS = 10000;
+
+// 64 bits FNV-1a, 8 bytes at a time rather than byte wise, folded to 32
+// bits: checked on every block read, it must not cost more than decoding
+static uint32_t _checksum(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < len; i++)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+static void _putVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t) value);
+}
+
+// Returns false past end, or for a value over 64 bits
+static inline bool _getVarint(const uint8_t *&p, const uint8_t *end, uint64_t *value)
+{
+    // Most deltas fit in a byte
+    if (p < end && !(*p & 0x80)) {
+        *value = *p++;
+        return true;
+    }
+
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint64_t _zigzag(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t _unzigzag(uint64_t value)
+{
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static bool _readAll(int fd, void *buffer, size_t len, uint64_t offset)
+{
+    for (size_t done = 0; done < len; ) {
+        ssize_t n = pread(fd, (char *) buffer + done, len - done, offset + done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool _writeAll(int fd, const void *buffer, size_t len)
+{
+    for (size_t done = 0; done < len; ) {
+        ssize_t n = write(fd, (const char *) buffer + done, len - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+// Header and payload of a block
+static void _encodeBlock(const RateArchive::Block &block, std::vector<uint8_t> &out)
+{
+    out.resize(sizeof(ArchiveBlockHeader));
+
+    size_t numColumns = 0;
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        if (block.columns[id].empty())
+            continue;
+        char code[4] = {};
+        memcpy(code, CurrencyCode(id), 3);
+        out.insert(out.end(), code, code + sizeof(code));
+        numColumns++;
+    }
+
+    for (size_t i = 1; i < block.days.size(); i++)
+        _putVarint(out, block.days[i] - block.days[i - 1]);
+
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        int64_t previous = 0;
+        for (size_t i = 0; i < block.columns[id].size(); i++) {
+            _putVarint(out, _zigzag(block.columns[id][i] - previous));
+            previous = block.columns[id][i];
+        }
+    }
+
+    ArchiveBlockHeader header = {};
+    header.firstDay = block.days.front();
+    header.lastDay = block.days.back();
+    header.numDays = block.days.size();
+    header.numColumns = numColumns;
+    header.payloadSize = out.size() - sizeof(header);
+    header.checksum = _checksum(out.data() + sizeof(header), header.payloadSize);
+    memcpy(out.data(), &header, sizeof(header));
+}
+
+// Reads and checks the payload of the block at offset
+static bool _readPayload(int fd, uint64_t offset, ArchiveBlockHeader &header, std::vector<uint8_t> &payload)
+{
+    if (!_readAll(fd, &header, sizeof(header), offset))
+        return false;
+
+    payload.resize(header.payloadSize);
+    return header.numDays > 0 && header.numDays <= RateArchive::BLOCK_DAYS
+        && header.payloadSize >= header.numColumns * 4u
+        && _readAll(fd, payload.data(), payload.size(), offset + sizeof(header))
+        && _checksum(payload.data(), payload.size()) == header.checksum;
+}
+
+// Decodes the days of a block payload. Returns where its columns start,
+// NULL if the payload is corrupted
+static const uint8_t *_decodeDays(const ArchiveBlockHeader &header, const std::vector<uint8_t> &payload,
+    int32_t *days)
+{
+    const uint8_t *p = payload.data() + header.numColumns * 4;
+    const uint8_t *end = payload.data() + payload.size();
+    uint64_t delta;
+
+    days[0] = header.firstDay;
+    for (size_t i = 1; i < header.numDays; i++) {
+        if (!_getVarint(p, end, &delta))
+            return NULL;
+        days[i] = days[i - 1] + (int32_t) delta;
+    }
+    return p;
+}
+
+// Calls column(id, values) for each column of a block payload from p,
+// values being the numDays scaled rates; id is INVALID_CURRENCY for a code
+// this version does not know. Returns false if the payload is corrupted
+template <typename ColumnFn>
+static bool _decodeColumns(const ArchiveBlockHeader &header, const std::vector<uint8_t> &payload,
+    const uint8_t *p, int64_t *values, ColumnFn column)
+{
+    const uint8_t *end = payload.data() + payload.size();
+    uint64_t delta;
+
+    for (size_t c = 0; c < header.numColumns; c++) {
+        int64_t value = 0;
+        for (size_t i = 0; i < header.numDays; i++) {
+            if (!_getVarint(p, end, &delta))
+                return false;
+            value += _unzigzag(delta);
+            values[i] = value;
+        }
+        const char *code = (const char *) payload.data() + c * 4;
+        column(CurrencyIdFromCode(code, strnlen(code, 4)), values);
+    }
+
+    return p == end;
+}
+
+RateArchive::RateArchive() :
+    m_size(0)
+{
+}
+
+int RateArchive::FirstDay() const
+{
+    if (!m_index.empty())
+        return m_index.front().firstDay;
+    return m_pending.days.empty() ? -1 : m_pending.days.front();
+}
+
+int RateArchive::LastDay() const
+{
+    if (!m_pending.days.empty())
+        return m_pending.days.back();
+    return m_index.empty() ? -1 : m_index.back().lastDay;
+}
+
+// Pending days of an archive, none if there are none or if they can't be read
+static void _loadPending(const std::string &pendingFn, RateArchive::Block &pending)
+{
+    int fd = open(pendingFn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    ArchiveBlockHeader header;
+    std::vector<uint8_t> payload;
+    bool ok = _readPayload(fd, 0, header, payload);
+    close(fd);
+    if (!ok)
+        return;
+
+    std::vector<int64_t> values(header.numDays);
+    pending.days.resize(header.numDays);
+    const uint8_t *columns = _decodeDays(header, payload, pending.days.data());
+    ok = columns && _decodeColumns(header, payload, columns, values.data(),
+        [&](CurrencyId id, const int64_t *column) {
+            if (id != INVALID_CURRENCY)
+                pending.columns[id].assign(column, column + header.numDays);
+        });
+    if (!ok)
+        pending = RateArchive::Block();
+}
+
+int RateArchive::Open(const std::string &fileName)
+{
+    m_fileName = fileName;
+    m_index.clear();
+    m_size = 0;
+    m_pending = Block();
+
+    // Pending days are read first: if a block is appended meanwhile, they
+    // are then found in the archive, rather than missed in both
+    Block pending;
+    _loadPending(fileName + PENDING_SUFFIX, pending);
+
+    int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    RateArchiveHeader header;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RATE_ARCHIVE_MAGIC, sizeof(header.magic));
+        header.version = RATE_ARCHIVE_VERSION;
+        if (!_writeAll(fd, &header, sizeof(header)) || fsync(fd) < 0) {
+            close(fd);
+            return -1;
+        }
+        st.st_size = sizeof(header);
+    } else if (!_readAll(fd, &header, sizeof(header), 0) ||
+        memcmp(header.magic, RATE_ARCHIVE_MAGIC, sizeof(header.magic)) ||
+        header.version != RATE_ARCHIVE_VERSION) {
+        close(fd);
+        return -1;
+    }
+
+    // Index: hop from block header to block header. A block being appended,
+    // or whose append was interrupted, is left out: the next append
+    // overwrites it
+    uint64_t offset = sizeof(header);
+    ArchiveBlockHeader blockHeader;
+    while (offset + sizeof(blockHeader) <= (uint64_t) st.st_size
+        && _readAll(fd, &blockHeader, sizeof(blockHeader), offset)
+        && offset + sizeof(blockHeader) + blockHeader.payloadSize <= (uint64_t) st.st_size) {
+        IndexEntry entry = { blockHeader.firstDay, blockHeader.lastDay, offset };
+        m_index.push_back(entry);
+        offset += sizeof(blockHeader) + blockHeader.payloadSize;
+    }
+    m_size = offset;
+    close(fd);
+
+    // Pending days already archived are dropped: the archive may have been
+    // appended to without the pending file being replaced
+    int lastArchived = m_index.empty() ? -1 : m_index.back().lastDay;
+    size_t first = 0;
+    while (first < pending.days.size() && pending.days[first] <= lastArchived)
+        first++;
+    if (first == pending.days.size())
+        return 0;
+
+    m_pending.days.assign(pending.days.begin() + first, pending.days.end());
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        if (!pending.columns[id].empty())
+            m_pending.columns[id].assign(pending.columns[id].begin() + first, pending.columns[id].end());
+    }
+
+    return 0;
+}
+
+int RateArchive::appendBlock(const Block &block)
+{
+    std::vector<uint8_t> encoded;
+    _encodeBlock(block, encoded);
+
+    int fd = open(m_fileName.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // Appends are locked: what follows the last block can only be what an
+    // interrupted append left
+    bool ok = lseek(fd, m_size, SEEK_SET) == (off_t) m_size
+        && _writeAll(fd, encoded.data(), encoded.size())
+        && ftruncate(fd, m_size + encoded.size()) == 0
+        && fsync(fd) == 0;
+    close(fd);
+    if (!ok)
+        return -1;
+
+    IndexEntry entry = { block.days.front(), block.days.back(), m_size };
+    m_index.push_back(entry);
+    m_size += encoded.size();
+    return 0;
+}
+
+int RateArchive::storePending() const
+{
+    std::string pendingFn = m_fileName + PENDING_SUFFIX;
+    if (m_pending.days.empty())
+        return (unlink(pendingFn.c_str()) == 0 || errno == ENOENT) ? 0 : -1;
+
+    std::vector<uint8_t> encoded;
+    _encodeBlock(m_pending, encoded);
+
+    std::string tmpFileName;
+    int fd = _createTempFile(pendingFn, tmpFileName);
+    if (fd < 0)
+        return -1;
+
+    bool ok = _writeAll(fd, encoded.data(), encoded.size());
+    return _commitTempFile(fd, tmpFileName, pendingFn, ok);
+}
+
+int RateArchive::appendDay(int day, const double *rates)
+{
+    size_t numDays = m_pending.days.size();
+    m_pending.days.push_back(day);
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        std::vector<int64_t> &column = m_pending.columns[id];
+        int64_t value = (rates[id] > 0) ? llround(rates[id] * RATE_SCALE) : 0;
+        if (value == 0 && column.empty())
+            continue;
+
+        // First time this currency shows up in the block: back fill
+        if (column.empty())
+            column.assign(numDays, 0);
+        column.push_back(value);
+    }
+
+    if (m_pending.days.size() < BLOCK_DAYS)
+        return 0;
+
+    if (appendBlock(m_pending) < 0)
+        return -1;
+    m_pending = Block();
+    return 0;
+}
+
+// Processes appending to the same archive are serialized by a lock on the
+// archive file, under which it is reopened: others may have appended
+template <typename AppendFn>
+int RateArchive::locked(AppendFn append)
+{
+    if (m_fileName.empty())
+        return -1;
+
+    bool contended = false;
+    int lock = _lockFile(m_fileName, ARCHIVE_LOCK_WAIT_MS, &contended);
+    if (lock < 0)
+        return -1;
+
+    int ret = (Open(m_fileName) == 0 && append() == 0 && storePending() == 0) ? 0 : -1;
+    close(lock);
+    return ret;
+}
+
+int RateArchive::Append(const RateSnapshot &rates)
+{
+    int day = rates.Date() / NUM_SECONDS_DAY;
+    if (rates.Empty())
+        return -1;
+
+    return locked([&]() {
+        if (day <= LastDay())
+            return (day == LastDay()) ? 0 : -1;
+
+        double dayRates[MAX_CURRENCIES];
+        for (CurrencyId id = 0; id < MAX_CURRENCIES; id++)
+            dayRates[id] = (id == CURRENCY_EUR) ? 0 : rates.Rate(id);
+        return appendDay(day, dayRates);
+    });
+}
+
+int RateArchive::Append(const RateHistory &history)
+{
+    const double *columns[MAX_CURRENCIES];
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++)
+        columns[id] = (id == CURRENCY_EUR) ? NULL : history.Column(id);
+
+    return locked([&]() {
+        const int32_t *days = history.Days();
+        for (size_t i = 0; i < history.NumDays(); i++) {
+            if (days[i] <= LastDay())
+                continue;
+
+            double dayRates[MAX_CURRENCIES];
+            for (CurrencyId id = 0; id < MAX_CURRENCIES; id++)
+                dayRates[id] = columns[id] ? columns[id][i] : 0;
+            if (appendDay(days[i], dayRates) < 0)
+                return -1;
+        }
+        return 0;
+    });
+}
+
+int RateArchive::Load(int fromDay, int toDay, RateHistory &history) const
+{
+    history.Clear();
+
+    int fd = open(m_fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // Blocks are in day order: skip those ending before the range
+    size_t block = 0, hi = m_index.size();
+    while (block < hi) {
+        size_t mid = (block + hi) / 2;
+        if (m_index[mid].lastDay < fromDay)
+            block = mid + 1;
+        else
+            hi = mid;
+    }
+
+    ArchiveBlockHeader header;
+    std::vector<uint8_t> payload;
+    int32_t days[BLOCK_DAYS];
+    int64_t values[BLOCK_DAYS];
+    bool ok = true;
+    for (; ok && block < m_index.size() && m_index[block].firstDay <= toDay; block++) {
+        const uint8_t *columns = NULL;
+        ok = _readPayload(fd, m_index[block].offset, header, payload)
+            && (columns = _decodeDays(header, payload, days)) != NULL;
+        if (!ok)
+            break;
+
+        // Days of the block in the range, appended to the history
+        size_t first = 0, last = header.numDays;
+        while (first < last && days[first] < fromDay)
+            first++;
+        while (last > first && days[last - 1] > toDay)
+            last--;
+        size_t base = history.m_days.size();
+        history.m_days.insert(history.m_days.end(), days + first, days + last);
+
+        ok = _decodeColumns(header, payload, columns, values, [&](CurrencyId id, const int64_t *column) {
+            if (id >= MAX_CURRENCIES)
+                return;
+            std::vector<double> &rates = history.m_columns[id];
+            rates.resize(base, NAN);
+            for (size_t i = first; i < last; i++)
+                rates.push_back(column[i] ? column[i] / RATE_SCALE : NAN);
+        });
+    }
+    close(fd);
+
+    // Pending days, all after the archived ones
+    for (size_t i = 0; ok && i < m_pending.days.size(); i++) {
+        int day = m_pending.days[i];
+        if (day < fromDay || day > toDay)
+            continue;
+        history.m_days.push_back(day);
+        for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+            if (m_pending.columns[id].empty())
+                continue;
+            std::vector<double> &rates = history.m_columns[id];
+            rates.resize(history.m_days.size() - 1, NAN);
+            int64_t value = m_pending.columns[id][i];
+            rates.push_back(value ? value / RATE_SCALE : NAN);
+        }
+    }
+
+    // Columns absent from the last blocks
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        if (!history.m_columns[id].empty())
+            history.m_columns[id].resize(history.m_days.size(), NAN);
+    }
+
+    if (!ok) {
+        history.Clear();
+        return -1;
+    }
+    return 0;
+}
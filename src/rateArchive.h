@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_RATE_ARCHIVE_H
+#define CC_RATE_ARCHIVE_H
+
+#include "rateHistory.h"
+#include "rateSnapshot.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace CurrencyConverter {
+
+//
+// Append-only archive of every daily snapshot, for audit.
+//
+// Days are grouped in blocks of up to BLOCK_DAYS business days. In a block,
+// rates are integers scaled by 10^RATE_DECIMALS, stored column wise as
+// deltas from the previous day, zigzag varint encoded: a rate moving by
+// less than 0.008 takes a byte or two. A year of rates fits in a few tens
+// of KB. Block headers form the index, read when the archive is opened,
+// so a date range only decodes the blocks covering it, a column at a time
+// into contiguous arrays.
+//
+// Full blocks are never rewritten: the days of the last, partial block are
+// kept next to the archive, in <archive>.pending, replaced atomically on
+// each append, and appended to the archive once BLOCK_DAYS days are in.
+//
+// Layout, in host byte order:
+//	RateArchiveHeader
+//	blocks: ArchiveBlockHeader, then payload:
+//		char codes[numColumns][4]
+//		varint day deltas[numDays - 1]	(first day in the header)
+//		numColumns x zigzag varint rate deltas[numDays]	(0 = no rate)
+//
+class RateArchive {
+public:
+	static const size_t BLOCK_DAYS = 64;
+
+	RateArchive();
+
+	// Opens or creates an archive. Returns -1 if it can't be read, or if
+	// it is not an archive. A truncated last block is ignored
+	int Open(const std::string &fileName);
+
+	// Appends the rates of a day after the last archived one. Rates of the
+	// last archived day are ignored. Returns -1 for an earlier day, or if
+	// the archive can't be written. Concurrent appends of several
+	// processes are serialized
+	int Append(const RateSnapshot &rates);
+	// Same for every day of a history after the last archived one
+	int Append(const RateHistory &history);
+
+	// Loads the rates of the days from fromDay to toDay included into
+	// history, replacing its content. Returns -1 if the archive can't be read
+	int Load(int fromDay, int toDay, RateHistory &history) const;
+
+	bool Empty() const { return FirstDay() < 0; }
+	int FirstDay() const;
+	int LastDay() const;
+	size_t NumBlocks() const { return m_index.size(); }
+	uint64_t Size() const { return m_size; }
+
+	// A decoded block: days and scaled rates, a column per currency, empty
+	// when absent from the block, 0 where a day has no rate
+	struct Block {
+		std::vector<int32_t> days;
+		std::vector<int64_t> columns[MAX_CURRENCIES];
+	};
+
+private:
+	struct IndexEntry {
+		int32_t firstDay;
+		int32_t lastDay;
+		uint64_t offset;	// Of the block header
+	};
+
+	// rates by currency ID, not positive or NaN when missing
+	int appendDay(int day, const double *rates);
+	int appendBlock(const Block &block);
+	int storePending() const;
+	template <typename AppendFn> int locked(AppendFn append);
+
+	std::string m_fileName;
+	std::vector<IndexEntry> m_index;
+	uint64_t m_size;		// Of the archive file, pending days excluded
+	Block m_pending;
+};
+
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rateCache.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <vector>
+
+using namespace CurrencyConverter;
+
+static uint64_t _checksum(const void *data, size_t len)
+{
+    // 64 bits FNV-1a
+    const unsigned char *bytes = (const unsigned char *) data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+int CurrencyConverter::StoreRateCache(const std::string &fileName, const RateSnapshot &rates)
+{
+    std::vector<RateCacheRecord> records;
+    records.reserve(rates.Count());
+
+    for (CurrencyId id = 0; id < NUM_KNOWN_CURRENCIES; id++) {
+        if (id == CURRENCY_EUR || !rates.HasRate(id))
+            continue;
+
+        RateCacheRecord record = {};
+        memcpy(record.code, CurrencyCode(id), sizeof(record.code));
+        record.rate = rates.Rate(id);
+        records.push_back(record);
+    }
+
+    RateCacheHeader header = {};
+    memcpy(header.magic, RATE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = RATE_CACHE_VERSION;
+    header.count = records.size();
+    header.ecbDate = rates.Date();
+    header.checksum = _checksum(records.data(), records.size() * sizeof(RateCacheRecord));
+
+    // Other processes may be loading the cache meanwhile
+    std::string tmpFileName;
+    int fd = _createTempFile(fileName, tmpFileName);
+    if (fd < 0)
+        return -1;
+
+    size_t recordsLen = records.size() * sizeof(RateCacheRecord);
+    bool ok = (write(fd, &header, sizeof(header)) == (ssize_t) sizeof(header))
+        && (write(fd, records.data(), recordsLen) == (ssize_t) recordsLen);
+
+    return _commitTempFile(fd, tmpFileName, fileName, ok);
+}
+
+int CurrencyConverter::LoadRateCache(const std::string &fileName, RateSnapshot &rates)
+{
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // A cache holds at most one record per currency: one read of a stack
+    // buffer gets it whole, one extra byte detects larger files
+    union {
+        RateCacheHeader header;
+        char bytes[sizeof(RateCacheHeader) + MAX_CURRENCIES * sizeof(RateCacheRecord) + 1];
+    } buffer;
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(buffer.bytes)
+        && (n = read(fd, buffer.bytes + len, sizeof(buffer.bytes) - len)) != 0) {
+        if (n < 0 && errno != EINTR)
+            break;
+        len += (n > 0) ? n : 0;
+    }
+    close(fd);
+
+    if (len < sizeof(RateCacheHeader) || len == sizeof(buffer.bytes))
+        return -1;
+
+    const RateCacheHeader *header = &buffer.header;
+    const RateCacheRecord *records = (const RateCacheRecord *) (header + 1);
+    size_t recordsLen = len - sizeof(RateCacheHeader);
+
+    if (memcmp(header->magic, RATE_CACHE_MAGIC, sizeof(header->magic))
+        || header->version != RATE_CACHE_VERSION
+        || header->count * sizeof(RateCacheRecord) != recordsLen
+        || header->checksum != _checksum(records, recordsLen))
+        return -1;
+
+    rates.Clear();
+    for (uint32_t i = 0; i < header->count; i++)
+        rates.SetRate(CurrencyIdFromCode(records[i].code, strnlen(records[i].code, 4)), records[i].rate);
+    rates.SetDate(header->ecbDate);
+    rates.BuildCrossRates();
+    return 0;
+}
+
+int CurrencyConverter::ImportTextRateCache(const std::string &ratesFn, const std::string &lastUpdatedFn, RateSnapshot &rates)
+{
+    std::ifstream ifs;
+
+    // Get last updated date from file: it is a time_t value in decimal format
+    ifs.open (lastUpdatedFn, std::ifstream::in);
+    if (!ifs.is_open()) {
+        return -1;
+    }
+
+    char time[128];
+    ifs.getline(time, 128);
+    ifs.close();
+
+    ifs.open (ratesFn, std::ifstream::in);
+    if (!ifs.is_open()) {
+        return -1;
+    }
+
+    rates.Clear();
+
+    // Now loop through each line of the file to retrieve stored data
+    int ret = -1;
+    char line[32];
+    std::string lineS;
+    while (!ifs.eof()) {
+        ifs.getline(line, 32);
+        lineS = line;
+        // Last line is an empty line. We must ignore it
+        if (lineS.size() > 4) {
+            // Currency code is 3 letters long, rest of the line is the currency rate
+            rates.SetRate(CurrencyIdFromCode(lineS.c_str(), 3), std::atof(lineS.c_str() + 4));
+            ret = 0;
+        }
+    }
+
+    rates.SetDate(static_cast<time_t> ( std::atol ( time ) ));
+    rates.BuildCrossRates();
+    return ret;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_RATE_CACHE_H
+#define CC_RATE_CACHE_H
+
+#include "rateSnapshot.h"
+#include <stdint.h>
+#include <string>
+
+namespace CurrencyConverter {
+
+//
+// Local rates cache: a fixed layout binary snapshot, rates and their date
+// in one small file, so loading it is a single read rather than parsing.
+//
+// Layout, in host byte order:
+//	RateCacheHeader
+//	RateCacheRecord[count]
+//
+static const char RATE_CACHE_MAGIC[8] = { 'C', 'C', 'R', 'A', 'T', 'E', 'S', '\0' };
+static const uint32_t RATE_CACHE_VERSION = 1;
+
+struct RateCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;		// Number of records following the header
+	int64_t ecbDate;	// ECB publication date and time (time_t)
+	uint64_t checksum;	// FNV-1a of the records
+};
+
+struct RateCacheRecord {
+	char code[4];		// NUL terminated ISO 4217 code
+	uint32_t reserved;
+	double rate;		// Rate against EUR
+};
+
+static_assert(sizeof(RateCacheHeader) == 32, "Unexpected rate cache header layout");
+static_assert(sizeof(RateCacheRecord) == 16, "Unexpected rate cache record layout");
+
+// Writes rates and their date to fileName. Returns 0 on success, -1 otherwise
+int StoreRateCache(const std::string &fileName, const RateSnapshot &rates);
+
+// Reads fileName and loads its rates and date into rates.
+// Returns 0 on success, -1 if the file is missing, truncated or corrupted
+int LoadRateCache(const std::string &fileName, RateSnapshot &rates);
+
+// Migration path from the former text cache: "CODE:rate" lines in ratesFn
+// and the update time_t, in decimal, in lastUpdatedFn
+int ImportTextRateCache(const std::string &ratesFn, const std::string &lastUpdatedFn, RateSnapshot &rates);
+
+} // namespace CurrencyConverter
+
+#endif
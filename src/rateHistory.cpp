@@ -0,0 +1,300 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rateHistory.h"
+#include "utils.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+// Rates of a business day still apply on the following closing days, but
+// not indefinitely: a date past the end of the history by more than this
+// is not covered.
+static const int MAX_DAYS_WITHOUT_RATES = 7;
+
+//
+// History file layout, in host byte order:
+//	HistoryFileHeader
+//	int32_t days[numDays], zero padded to a multiple of 8 bytes
+//	numColumns x { HistoryFileColumn, double rates[numDays] }
+//
+static const char HISTORY_FILE_MAGIC[8] = { 'C', 'C', 'H', 'I', 'S', 'T', '\0', '\0' };
+static const uint32_t HISTORY_FILE_VERSION = 2;
+
+struct HistoryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numDays;
+    uint32_t numColumns;
+    uint32_t reserved;
+};
+
+struct HistoryFileColumn {
+    char code[4];
+    uint32_t reserved;
+};
+
+// Length of the days array, padded for the rates that follow to be aligned
+static size_t _daysLength(size_t numDays)
+{
+    return (numDays * sizeof(int32_t) + sizeof(double) - 1) & ~(sizeof(double) - 1);
+}
+
+RateHistory::RateHistory()
+{
+}
+
+void RateHistory::Clear()
+{
+    m_days.clear();
+    for (size_t i = 0; i < MAX_CURRENCIES; i++)
+        m_columns[i].clear();
+}
+
+void RateHistory::appendDay(int day)
+{
+    m_days.push_back(day);
+    for (size_t i = 0; i < MAX_CURRENCIES; i++) {
+        if (!m_columns[i].empty())
+            m_columns[i].push_back(NAN);
+    }
+}
+
+void RateHistory::setRate(CurrencyId id, double rate)
+{
+    if (id >= MAX_CURRENCIES || m_days.empty())
+        return;
+
+    // First time this currency shows up: back fill its column
+    std::vector<double> &column = m_columns[id];
+    if (column.empty())
+        column.assign(m_days.size(), NAN);
+
+    column.back() = rate;
+}
+
+void RateHistory::sortDays()
+{
+    // ECB documents list the most recent day first
+    size_t n = m_days.size();
+    bool descending = true, ascending = true;
+    for (size_t i = 1; i < n; i++) {
+        descending &= m_days[i] < m_days[i - 1];
+        ascending &= m_days[i] > m_days[i - 1];
+    }
+
+    if (ascending)
+        return;
+
+    if (descending) {
+        std::reverse(m_days.begin(), m_days.end());
+        for (size_t c = 0; c < MAX_CURRENCIES; c++)
+            std::reverse(m_columns[c].begin(), m_columns[c].end());
+        return;
+    }
+
+    // Arbitrary order: sort, and keep the last occurrence of duplicate days
+    std::vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return m_days[a] < m_days[b];
+    });
+
+    std::vector<uint32_t> keep;
+    for (size_t i = 0; i < n; i++) {
+        if (i + 1 < n && m_days[order[i]] == m_days[order[i + 1]])
+            continue;
+        keep.push_back(order[i]);
+    }
+
+    std::vector<int32_t> days(keep.size());
+    for (size_t i = 0; i < keep.size(); i++)
+        days[i] = m_days[keep[i]];
+    m_days.swap(days);
+
+    for (size_t c = 0; c < MAX_CURRENCIES; c++) {
+        if (m_columns[c].empty())
+            continue;
+        std::vector<double> column(keep.size());
+        for (size_t i = 0; i < keep.size(); i++)
+            column[i] = m_columns[c][keep[i]];
+        m_columns[c].swap(column);
+    }
+}
+
+bool HistoryXmlHandler::OnDate(const char *date)
+{
+    // The rates of a malformed date are skipped, the other days kept
+    int day = ecbDateToDay(date);
+    m_hasDay = (day >= 0);
+    if (m_hasDay)
+        m_history.appendDay(day);
+    return true;
+}
+
+void HistoryXmlHandler::OnRate(CurrencyId currency, double rate)
+{
+    if (m_hasDay)
+        m_history.setRate(currency, rate);
+}
+
+void HistoryXmlHandler::Finish()
+{
+    m_history.sortDays();
+}
+
+int RateHistory::ImportEcbXmlFile(const std::string &fileName)
+{
+    Clear();
+    HistoryXmlHandler handler(*this);
+    EcbXmlParser parser(handler);
+
+    if (parser.FeedFile(fileName) < 0 || parser.Finish() < 0) {
+        Clear();
+        return -1;
+    }
+
+    handler.Finish();
+    return 0;
+}
+
+int RateHistory::DayIndex(int day) const
+{
+    if (m_days.empty() || day < m_days.front() || day > m_days.back() + MAX_DAYS_WITHOUT_RATES)
+        return -1;
+
+    std::vector<int32_t>::const_iterator it = std::upper_bound(m_days.begin(), m_days.end(), day);
+    return (it - m_days.begin()) - 1;
+}
+
+double RateHistory::Rate(CurrencyId id, int day) const
+{
+    if (id == CURRENCY_EUR)
+        return DayIndex(day) < 0 ? -1 : 1;
+
+    const double *column = Column(id);
+    int index = DayIndex(day);
+    if (!column || index < 0 || isnan(column[index]))
+        return -1;
+
+    return column[index];
+}
+
+const double *RateHistory::Column(CurrencyId id) const
+{
+    if (id >= MAX_CURRENCIES || m_columns[id].empty())
+        return NULL;
+
+    return m_columns[id].data();
+}
+
+static bool _writeAll(int fd, const void *data, size_t len)
+{
+    return write(fd, data, len) == (ssize_t) len;
+}
+
+int RateHistory::Store(const std::string &fileName) const
+{
+    HistoryFileHeader header = {};
+    memcpy(header.magic, HISTORY_FILE_MAGIC, sizeof(header.magic));
+    header.version = HISTORY_FILE_VERSION;
+    header.numDays = m_days.size();
+    for (CurrencyId id = 0; id < NUM_KNOWN_CURRENCIES; id++) {
+        if (!m_columns[id].empty())
+            header.numColumns++;
+    }
+
+    // Readers map the file: never rewrite it in place
+    std::string tmpFileName;
+    int fd = _createTempFile(fileName, tmpFileName);
+    if (fd < 0)
+        return -1;
+
+    static const char padding[sizeof(double)] = {};
+    size_t daysLen = m_days.size() * sizeof(int32_t);
+    bool ok = _writeAll(fd, &header, sizeof(header))
+        && _writeAll(fd, m_days.data(), daysLen)
+        && _writeAll(fd, padding, _daysLength(m_days.size()) - daysLen);
+
+    for (CurrencyId id = 0; ok && id < NUM_KNOWN_CURRENCIES; id++) {
+        if (m_columns[id].empty())
+            continue;
+
+        HistoryFileColumn column = {};
+        memcpy(column.code, CurrencyCode(id), sizeof(column.code));
+        ok = _writeAll(fd, &column, sizeof(column))
+            && _writeAll(fd, m_columns[id].data(), m_columns[id].size() * sizeof(double));
+    }
+
+    return _commitTempFile(fd, tmpFileName, fileName, ok);
+}
+
+int RateHistory::Load(const std::string &fileName)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(HistoryFileHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t len = st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const char *data = (const char *) map;
+    const HistoryFileHeader *header = (const HistoryFileHeader *) data;
+    size_t daysLen = _daysLength(header->numDays);
+    size_t columnLen = sizeof(HistoryFileColumn) + header->numDays * sizeof(double);
+
+    int ret = -1;
+    if (!memcmp(header->magic, HISTORY_FILE_MAGIC, sizeof(header->magic))
+        && header->version == HISTORY_FILE_VERSION
+        && len == sizeof(HistoryFileHeader) + daysLen + header->numColumns * columnLen) {
+        Clear();
+
+        const int32_t *days = (const int32_t *) (header + 1);
+        m_days.assign(days, days + header->numDays);
+
+        const char *columns = data + sizeof(HistoryFileHeader) + daysLen;
+        for (uint32_t c = 0; c < header->numColumns; c++, columns += columnLen) {
+            const HistoryFileColumn *column = (const HistoryFileColumn *) columns;
+            const double *rates = (const double *) (column + 1);
+            CurrencyId id = CurrencyIdFromCode(column->code, strnlen(column->code, 4));
+            if (id < MAX_CURRENCIES)
+                m_columns[id].assign(rates, rates + header->numDays);
+        }
+        ret = 0;
+    }
+
+    munmap(map, len);
+    return ret;
+}
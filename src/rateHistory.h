@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_RATE_HISTORY_H
+#define CC_RATE_HISTORY_H
+
+#include "currency.h"
+#include "ecbXmlParser.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace CurrencyConverter {
+
+//
+// Reference rates history, stored column wise: one array of business days
+// (day numbers, ascending) and one rates column per currency, aligned on
+// the days array. A rate missing for a day is stored as NaN.
+// 25 years of ECB history for every currency fit in a few MB, and the
+// rates as of a date are found by a binary search on the days.
+//
+class RateHistory {
+public:
+	RateHistory();
+	void Clear();
+
+	// Imports a full ECB history document (eurofxref-hist.xml) from disk
+	int ImportEcbXmlFile(const std::string &fileName);
+
+	// Binary persistence. Both return 0 on success, -1 otherwise
+	int Store(const std::string &fileName) const;
+	int Load(const std::string &fileName);
+
+	// Index of the business day whose rates apply on day: the latest one
+	// not after day, -1 if day is not covered by the history
+	int DayIndex(int day) const;
+	// Rate against EUR as of day, negative if not available
+	double Rate(CurrencyId id, int day) const;
+
+	bool Empty() const { return m_days.empty(); }
+	size_t NumDays() const { return m_days.size(); }
+	int FirstDay() const { return m_days.empty() ? -1 : m_days.front(); }
+	int LastDay() const { return m_days.empty() ? -1 : m_days.back(); }
+	const int32_t *Days() const { return m_days.data(); }
+	// Rates column of a currency, NULL if it was never published
+	const double *Column(CurrencyId id) const;
+
+private:
+	friend class HistoryXmlHandler;
+	friend class RateArchive;
+	void appendDay(int day);
+	void setRate(CurrencyId id, double rate);
+	void sortDays();
+
+	std::vector<int32_t> m_days;
+	std::vector<double> m_columns[MAX_CURRENCIES];
+};
+
+// Feeds an ECB history document into a RateHistory. Call Finish() on the
+// history handler once the whole document has been parsed.
+class HistoryXmlHandler : public EcbXmlHandler {
+public:
+	explicit HistoryXmlHandler(RateHistory &history) : m_history(history), m_hasDay(false) {}
+	bool OnDate(const char *date);
+	void OnRate(CurrencyId currency, double rate);
+	void Finish();
+
+private:
+	RateHistory &m_history;
+	bool m_hasDay;
+};
+
+} // namespace CurrencyConverter
+
+#endif
@@ -18,21 +18,31 @@
  */
 
 #include "rateManager.h"
-#include <curl/curl.h>
-#include <libxml/xmlreader.h>
-#include <libxml/parser.h>
-#include <libxml/tree.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <exception>
-#include <fstream>
+#include <unistd.h>
+#include <memory>
 #include "utils.h"
+#include "rateCache.h"
+#include "ecbXmlParser.h"
+#include "convertKernels.h"
+#include "metrics.h"
+#include "rateSource.h"
+#include "ledger.h"
+#include <algorithm>
+#include <thread>
 
 using namespace CurrencyConverter;
 
 static const char * EURO_FOREIGN_EXCHANGE_REFERENCE_RATES_LINK =
     "https://www.ecb.europa.eu/stats/eurofxref/eurofxref-daily.xml";
+static const char * EURO_FOREIGN_EXCHANGE_REFERENCE_RATES_HISTORY_LINK =
+    "https://www.ecb.europa.eu/stats/eurofxref/eurofxref-hist.xml";
+// The full history is a few megabytes
+static const unsigned HISTORY_TIMEOUT_MS = 300000;
+// How long a process waits for another one downloading rates
+static const unsigned REFRESH_LEASE_WAIT_MS = 10000;
 
 RateManager RateManager::m_instance = RateManager();
 
@@ -43,15 +53,16 @@ RateManager& RateManager::Instance()
 
 RateManager::RateManager()
 {
-    m_rates = {};
-    m_lastUpdated = 0;
+    m_ratesLoaded.store(false, std::memory_order_relaxed);
+    m_historyLoaded = false;
 }
 	
 RateManager::~RateManager()
 {
+    StopBackgroundRefresh();
 }
 
-bool RateManager::storedRatesUpToDate()
+bool RateManager::storedRatesUpToDate(time_t storedUpdateTime)
 {
     //
     // From "https://www.ecb.europa.eu/stats/policy_and_exchange_rates/euro_reference_exchange_rates/html/index.en.html"
@@ -66,253 +77,632 @@ bool RateManager::storedRatesUpToDate()
     // If these numbers differ, it means that rates are not up to date and must be updated.
     //
 
-    std::string updateDateFn = _getLastUpdatedFileName();
-
-    // Try and open file that contains last updated date
-    std::ifstream ifs;
-    ifs.open (updateDateFn, std::ifstream::in);
-    if (!ifs.is_open()) {
-#ifdef DEBUG
-        std::cerr << "Failed to open " << updateDateFn << '\n';
-#endif
-        return false;
-    }
-
-    // Get last updated date from file: it is a time_t value in decimal format
-    char time[128];
-    ifs.getline(time, 128);
-    ifs.close();
-
-    // Get ECB updated time as per current date and time
-    // and compare with value retrieved from the file
+    StageTimer timer(STAGE_UP_TO_DATE_CHECK);
     time_t ecbUpdatedTime = getEcbLastUpdateTime();
-    time_t localUpdatedTime = static_cast<time_t> ( std::atoi ( time ) );
 
-    if ( localUpdatedTime < ecbUpdatedTime)
+    if ( storedUpdateTime < ecbUpdatedTime)
         return false;
 
 #ifdef DEBUG
-    std::cout << "Rates are up to date: local=" << localUpdatedTime << ", website= " << ecbUpdatedTime << '\n';
+    std::cout << "Rates are up to date: local=" << storedUpdateTime << ", website= " << ecbUpdatedTime << '\n';
 #endif
 
-    // Update "last updated" member variable
-    m_lastUpdated = localUpdatedTime;
     return true;
 }
 
 
-#define ATTR_NAME_IS(A)  !strcmp( (const char *)attr->name, A)
-static void _extractRatesFromXmlDoc(xmlNode * a_node, CurrencyRatesTable *rates, time_t *updateDate)
+void RateManager::ExtractRatesFromECBXml(void *buffer, size_t size)
 {
-    xmlNode *cur_node = NULL;
-    xmlAttr *attr = NULL;
-    std::string currency = "none";
-    double currencyVal;
+    std::unique_ptr<RateSnapshot> rates(m_rates.Acquire());
+    {
+        StageTimer timer(STAGE_XML_PARSE);
+        SnapshotXmlHandler handler(*rates);
+        EcbXmlParser parser(handler);
+
+        if (parser.Feed((const char *) buffer, size) < 0 || parser.Finish() < 0) {
+            fprintf(stderr, "Failed to parse document\n");
+            return;
+        }
+    }
 
-    for (cur_node = a_node; cur_node; cur_node = cur_node->next) {
-        if (cur_node->type == XML_ELEMENT_NODE) {
-            attr = cur_node->properties;
-            while (attr) {
-                if ( ATTR_NAME_IS("currency") ) {
-                    currency = (const char *)attr->children->content;
-                } else if (ATTR_NAME_IS("rate"))  {
-                    currencyVal = std::atof( (const char *) attr->children->content);
-                } else if (ATTR_NAME_IS("time"))  {
-#ifdef DEBUG
-                    printf("Exchange rate date is %s\n", (char *) attr->children->content);
-#endif
-                    *updateDate = ecbDateToTime( (char *) attr->children->content );
-                }
-                attr = attr->next;
-            }
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    publishRates(rates.release());
+    m_ratesLoaded.store(true, std::memory_order_release);
+}
 
-            if (currency != "none") {
-                rates->insert(std::pair<std::string, double> (currency, currencyVal) );
-#ifdef DEBUG
-                printf("New Currency (%s) Value  (%.4f)\n", currency.c_str(), currencyVal);
-#endif
-            }
+int RateManager::AddRateSource(const std::string &spec, unsigned timeoutMs)
+{
+    RateSource *source = CreateRateSource(spec, timeoutMs);
+    if (!source)
+        return -1;
 
-            // Reset currency name
-            currency= "none";
-        }
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    m_sources.emplace_back(source);
+    return 0;
+}
+
+int RateManager::AddRateQuotes(const std::string &fileName)
+{
+    std::vector<RateQuote> quotes;
+    if (LoadRateQuotes(fileName, quotes) < 0)
+        return -1;
 
-        _extractRatesFromXmlDoc(cur_node->children, rates, updateDate);
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    if (m_quotes.size() + quotes.size() > RateSnapshot::MAX_QUOTES) {
+        std::cerr << "ERROR: Too many quotes, at most " << RateSnapshot::MAX_QUOTES << " are supported\n";
+        return -1;
+    }
+    m_quotes.insert(m_quotes.end(), quotes.begin(), quotes.end());
+
+    // Current rates get the quotes at once
+    SnapshotGuard current(m_rates);
+    if (current.Get()) {
+        RateSnapshot *rates = m_rates.Acquire();
+        *rates = *current.Get();
+        publishRates(rates);
     }
+    return 0;
 }
 
-void RateManager::ExtractRatesFromECBXml(void *buffer, size_t size)
+// Called with m_refreshLock held
+void RateManager::publishRates(RateSnapshot *rates)
 {
-   /*
-     * The document being in memory, it have no base per RFC 2396,
-     * and the "noname.xml" argument will serve as its base.
-     */
-    xmlDocPtr  doc = xmlReadMemory((const char *)buffer, (int)size, "noname.xml", NULL, 0);
-    if (doc == NULL) {
-        fprintf(stderr, "Failed to parse document\n");
-		return;
-    }
+    rates->SetQuotes(m_quotes.data(), m_quotes.size());
+    rates->BuildCrossRates();
+    m_rates.Publish(rates);
+}
 
-    /*Get the root element node */
-    xmlNode *root_element = xmlDocGetRootElement(doc);
+int RateManager::EnableSharedRates()
+{
+    std::unique_ptr<SharedRateTable> sharedRates(new SharedRateTable());
+    if (sharedRates->Open(_getSharedRatesName()) < 0) {
+        std::cerr << "ERROR: Failed to open shared rates " << _getSharedRatesName() << '\n';
+        return -1;
+    }
 
-    _extractRatesFromXmlDoc(root_element, &m_rates, &m_lastUpdated);
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    m_sharedRates.swap(sharedRates);
+    return 0;
 }
 
-static size_t _ExtractRatesFromECBXml(void *buffer, size_t size, size_t nmemb, void *userp)
+int RateManager::EnableArchive()
 {
-	RateManager *rr = (RateManager *) userp;
+    std::unique_ptr<RateArchive> archive(new RateArchive());
+    if (archive->Open(_getArchiveFileName()) < 0) {
+        std::cerr << "ERROR: Failed to open rates archive " << _getArchiveFileName() << '\n';
+        return -1;
+    }
 
-	rr->ExtractRatesFromECBXml(buffer, nmemb);
-	return nmemb;
+    std::lock_guard<std::mutex> lock(m_archiveLock);
+    m_archive.swap(archive);
+    return 0;
 }
 
-int RateManager::getECBRates()
+// Opened again: other processes may have appended to it
+int RateManager::LoadArchive(int fromDay, int toDay, RateHistory &history)
 {
-    CURL *curl;
-    CURLcode ret = CURLE_COULDNT_CONNECT;
-
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, EURO_FOREIGN_EXCHANGE_REFERENCE_RATES_LINK);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _ExtractRatesFromECBXml);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
-
-        /* Try and get the XML file from European Central Bank */
-        ret = curl_easy_perform(curl);
-        if (ret != CURLE_OK) {
-            std::cerr <<  "ERROR: Failed to get exchange rates from European Central Bank: " <<
-                curl_easy_strerror(ret) << std::endl;
-        }
+    RateArchive archive;
+    if (archive.Open(_getArchiveFileName()) < 0 || archive.Load(fromDay, toDay, history) < 0) {
+        std::cerr << "ERROR: Failed to load rates archive " << _getArchiveFileName() << '\n';
+        return -1;
+    }
 
-        curl_easy_cleanup(curl);
+    return 0;
+}
 
-        // Store rates and update time locally
-        storeECBRates();
-        storedECBUpdateTime();
-    }
+// Archiving is best effort: rates are used whether or not they are archived
+void RateManager::archiveRates(const RateSnapshot &rates)
+{
+    std::lock_guard<std::mutex> lock(m_archiveLock);
+    if (m_archive && m_archive->Append(rates) < 0)
+        std::cerr << "ERROR: Failed to archive exchange rates in " << _getArchiveFileName() << '\n';
+}
 
-    curl_global_cleanup();
-    return (ret == CURLE_OK) ? 0 : -1;
+// Called with m_historyLock held
+void RateManager::archiveHistory()
+{
+    std::lock_guard<std::mutex> lock(m_archiveLock);
+    if (m_archive && m_archive->Append(m_history) < 0)
+        std::cerr << "ERROR: Failed to archive exchange rates history in " << _getArchiveFileName() << '\n';
 }
 
-void RateManager::storeECBRates()
+// The document of a source, parsed into its own snapshot
+struct SourceDocument {
+    explicit SourceDocument(RateSnapshot *snapshot) : rates(snapshot), handler(*rates), parser(handler) {}
+
+    std::unique_ptr<RateSnapshot> rates;
+    SnapshotXmlHandler handler;
+    EcbXmlParser parser;
+};
+
+// Called with m_refreshLock held
+int RateManager::getECBRates()
 {
-    std::string localStorageFn = _getStorageFileName();
+    if (m_sources.empty())
+        m_sources.emplace_back(new HttpRateSource(EURO_FOREIGN_EXCHANGE_REFERENCE_RATES_LINK, DEFAULT_SOURCE_TIMEOUT_MS));
+
+    // Downloads are conditional while the cache holds a document: ECB
+    // answers 304 Not Modified until it publishes new rates, and the cached
+    // ones are then served again, with nothing to parse or store
+    std::unique_ptr<RateSnapshot> cached(m_rates.Acquire());
+    SourceValidators validators;
+    std::string validatorsFn = _getValidatorsFileName();
+    if (LoadRateCache(_getRateCacheFileName(), *cached) == 0)
+        LoadSourceValidators(validatorsFn, validators);
+
+    // Parse into separate snapshots: current rates stay usable if every
+    // source fails. Rates are parsed as they are received
+    std::vector<std::unique_ptr<SourceDocument>> documents;
+    std::vector<SourceFetch> fetches(m_sources.size());
+    for (size_t i = 0; i < m_sources.size(); i++) {
+        documents.emplace_back(new SourceDocument(m_rates.Acquire()));
+        fetches[i].parser = &documents.back()->parser;
+
+        SourceValidators::const_iterator it = validators.find(m_sources[i]->Location());
+        if (it != validators.end())
+            fetches[i].validators = it->second;
+    }
 
-    // Try and open local storage file for writing only
-    std::ofstream ofs;
-    ofs.open (localStorageFn, std::ofstream::out);
+    uint64_t parseNs = 0;
+    int winner;
 
-    if (ofs.is_open()) {
-        for (auto& currency : m_rates) {
-            ofs << currency.first << ":" << currency.second << '\n';
-        }
+    Metrics::Increment(COUNTER_ECB_FETCHES);
+    {
+        StageTimer timer(STAGE_ECB_FETCH);
+        winner = FetchFirstDocument(m_sources, fetches.data(), &parseNs);
+    }
+    Metrics::Record(STAGE_XML_PARSE, parseNs);
+
+    if (winner >= 0 && fetches[winner].notModified) {
+        Metrics::Increment(COUNTER_ECB_NOT_MODIFIED);
+        if (m_sharedRates)
+            m_sharedRates->Write(*cached);
+        publishRates(cached.release());
+        return 0;
     }
 
-    ofs.close();
+    if (winner < 0 || documents[winner]->rates->Empty()) {
+        Metrics::Increment(COUNTER_ECB_FETCH_FAILURES);
+        return -1;
+    }
+
+    std::unique_ptr<RateSnapshot> rates(documents[winner]->rates.release());
+    archiveRates(*rates);
+
+    // Store rates and update time locally, then what identifies them.
+    // Validators of the other sources identify a document that is not
+    // cached any more: they are dropped
+    const RateSource &source = *m_sources[winner];
+    if (storeECBRates(*rates) == 0) {
+        validators.clear();
+        if (source.Remote() && !fetches[winner].validators.Empty())
+            validators[source.Location()] = fetches[winner].validators;
+        StoreSourceValidators(validatorsFn, validators);
+    }
+
+    if (m_sharedRates)
+        m_sharedRates->Write(*rates);
+    publishRates(rates.release());
+    return 0;
 }
 
-void RateManager::storedECBUpdateTime()
+int RateManager::storeECBRates(const RateSnapshot &rates)
 {
-    std::string updateDateFn = _getLastUpdatedFileName();
+    StageTimer timer(STAGE_CACHE_STORE);
+    std::string rateCacheFn = _getRateCacheFileName();
 
-    // Try and open local "last updated date" for writing only
-    std::ofstream ofs;
-    ofs.open (updateDateFn, std::ofstream::out);
-
-    if (ofs.is_open()) {
-        ofs << m_lastUpdated;
+    if (StoreRateCache(rateCacheFn, rates) < 0) {
+        Metrics::Increment(COUNTER_CACHE_STORE_FAILURES);
+        std::cerr << "ERROR: Failed to store exchange rates in " << rateCacheFn << '\n';
+        return -1;
     }
 
-    ofs.close();
+    return 0;
 }
 
-int RateManager::getStoredRates()
+int RateManager::getStoredRates(bool acceptOutdated)
 {
+    StageTimer timer(STAGE_CACHE_LOAD);
+    std::unique_ptr<RateSnapshot> rates(m_rates.Acquire());
+
+    // Another process may have published up to date rates: no file to read
+    if (m_sharedRates && m_sharedRates->Read(*rates) == 0 &&
+        (acceptOutdated || storedRatesUpToDate(rates->Date()))) {
+        Metrics::Increment(COUNTER_SHARED_RATES_HITS);
+        publishRates(rates.release());
+        return 0;
+    }
+
+    std::string rateCacheFn = _getRateCacheFileName();
+    if (LoadRateCache(rateCacheFn, *rates) < 0) {
+        // No usable binary cache: migrate the former text cache, if any
+        if (ImportTextRateCache(_getStorageFileName(), _getLastUpdatedFileName(), *rates) < 0) {
+            Metrics::Increment(COUNTER_CACHE_MISSES);
+            return -1;
+        }
+        StoreRateCache(rateCacheFn, *rates);
+    }
+
     // Check that stored rates are not outdated
-    if ( ! storedRatesUpToDate() ) {
+    if ( !acceptOutdated && !storedRatesUpToDate(rates->Date()) ) {
 #ifdef DEBUG
         std::cout << "Stored rates are outdated \n";
 #endif
+        Metrics::Increment(COUNTER_CACHE_MISSES);
         return -1;
     }
 
-    std::string localStorageFn = _getStorageFileName();
+    Metrics::Increment(COUNTER_CACHE_HITS);
+    if (m_sharedRates)
+        m_sharedRates->Write(*rates);
+    publishRates(rates.release());
+    return 0;
+}
 
-    // Try and open local storage file for reading
-    std::ifstream ifs;
-    ifs.open (localStorageFn, std::ifstream::in);
-    if (!ifs.is_open()) {
+// Called with m_refreshLock held
+int RateManager::loadRates()
+{
+    if ( getStoredRates(false) < 0 && refreshRates() < 0 )
         return -1;
-    }
 
-    // Now loop through each line of the file to retrieve stored data
-    int ret = -1;
-    char line[32];
-    std::string lineS;
-    while (!ifs.eof()) {
-        ifs.getline(line, 32);
-        lineS = line;
-        // Last line is an empty line. We must ignore it
-        if (! lineS.empty()) {
-            // Currency code is 3 letters long
-            std::string currencyCode = lineS.substr(0,3);
-            // Rest of the line is the currency rate
-            double currencyRate = std::atof(lineS.substr(4, lineS.size()).c_str() );
-            m_rates.insert(std::pair<std::string, double> (currencyCode, currencyRate) );
-            ret = 0;
-        }
+    m_ratesLoaded.store(true, std::memory_order_release);
+    return 0;
+}
+
+// Called with m_refreshLock held, once stored rates were found outdated.
+// When rates go stale, every running process notices at the same time:
+// the refresh lease makes the downloads single flight. Its holder gets
+// rates from the European Central Bank website and stores them; the others
+// wait for it, then load what it stored. If it takes too long, they serve
+// the previous rates
+int RateManager::refreshRates()
+{
+    bool contended = false;
+    int lease = _lockFile(_getRefreshLeaseFileName(), REFRESH_LEASE_WAIT_MS, &contended);
+    if (contended)
+        Metrics::Increment(COUNTER_REFRESH_LEASE_WAITS);
+
+    if (contended && lease >= 0 && getStoredRates(false) == 0) {
+        Metrics::Increment(COUNTER_REFRESH_SHARED);
+        close(lease);
+        return 0;
     }
+    if (contended && lease < 0 && getStoredRates(true) == 0)
+        return 0;
 
+    // Also without the lease if it can't be had: no rates at all otherwise
+    int ret = getECBRates();
+    if (lease >= 0)
+        close(lease);
     return ret;
 }
 
 int RateManager::getRates()
 {
-    if ( getStoredRates() < 0 ) {
-        // stored rates are either outdated or non present:
-        // get rates from European Central Bank website
-        return getECBRates();
-    }
+    // Rates are resolved once per process: long running users (stream mode)
+    // must not pay for the cache files or the network on every conversion
+    if (m_ratesLoaded.load(std::memory_order_acquire))
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    if (m_ratesLoaded.load(std::memory_order_relaxed))
+        return 0;
+
+    // Conversions never fetch while the background refresh is in charge
+    if (m_scheduler)
+        return -1;
+
+    return loadRates();
+}
+
+int RateManager::LoadRates()
+{
+    return getRates();
+}
 
+int RateManager::RefreshRates()
+{
+    // Readers keep converting with the current snapshot meanwhile
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    return loadRates();
+}
+
+int RateManager::StartBackgroundRefresh()
+{
+    std::lock_guard<std::mutex> lock(m_refreshLock);
+    if (m_scheduler)
+        return 0;
+
+    // Serve whatever is stored, even outdated, until the first refresh
+    if (!m_ratesLoaded.load(std::memory_order_relaxed) && getStoredRates(true) == 0)
+        m_ratesLoaded.store(true, std::memory_order_release);
+
+    m_scheduler.reset(new RefreshScheduler(*this));
+    m_scheduler->Start();
     return 0;
 }
 
-double RateManager::CurrencyToRate(const std::string &currency)
+void RateManager::StopBackgroundRefresh()
+{
+    std::unique_ptr<RefreshScheduler> scheduler;
+    {
+        std::lock_guard<std::mutex> lock(m_refreshLock);
+        scheduler.swap(m_scheduler);
+    }
+
+    // Stopping waits for an ongoing refresh, which needs m_refreshLock
+    if (scheduler)
+        scheduler->Stop();
+}
+
+RefreshState RateManager::GetRefreshState()
 {
-    double rate;
+    {
+        std::lock_guard<std::mutex> lock(m_refreshLock);
+        if (m_scheduler)
+            return m_scheduler->State();
+    }
+
+    RefreshState state = {};
+    state.ratesDate = GetRatesLastUpdatedDate();
+    return state;
+}
+
+double RateManager::Convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency)
+{
+    StageTimer timer(STAGE_CONVERT);
+    double convertedAmount = convert(amount, fromCurrency, toCurrency);
+    if (convertedAmount < 0)
+        Metrics::Increment(COUNTER_CONVERSION_ERRORS);
+    return convertedAmount;
+}
+
+double RateManager::convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency)
+{
+    if ( getRates() < 0) {
+        return (double) -1;
+    }
+
+    // The checks and the conversion below use the same snapshot
+    SnapshotGuard rates(m_rates);
+
+    CurrencyId toId = LookupCurrency(toCurrency.c_str(), toCurrency.size());
+    if (!rates->Available(toId)) {
+        std::cerr << "ERROR: Could not find Currency " << toCurrency << '\n';
+        return (double) -1;
+    }
 
-    // EUR is not part of table, so we need to
-    // treat it separately
-    if (currency == "EUR") {
-        rate = (double) 1;
-        return rate;
+    CurrencyId fromId = LookupCurrency(fromCurrency.c_str(), fromCurrency.size());
+    if (!rates->Available(fromId)) {
+        std::cerr << "ERROR: Could not find Currency " << fromCurrency << '\n';
+        return (double) -1;
     }
 
-    try {
-        rate = m_rates.at(currency);
-    } catch (std::exception &e) {
+   if (amount < 0) {
+        std::cerr << "ERROR: Amount to convert (" << amount << ") is invalid\n";
         return (double) -1;
     }
 
-    return rate;
+    return Convert(amount, fromId, toId);
 }
 
-double RateManager::Convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency)
+double RateManager::Convert(double amount, CurrencyId fromCurrency, CurrencyId toCurrency)
+{
+    // Fast path: no validation message, no allocation, a single lookup.
+    // Callers resolve IDs once and must have loaded rates (LoadRates).
+    SnapshotGuard rates(m_rates);
+    if (!rates.Get())
+        return (double) -1;
+
+    double crossRate = rates->CrossRate(fromCurrency, toCurrency);
+    if (crossRate < 0 || amount < 0)
+        return (double) -1;
+
+    return amount * crossRate;
+}
+
+int RateManager::ConvertMany(const double *amounts, double *out, size_t count,
+    CurrencyId fromCurrency, CurrencyId toCurrency)
+{
+    if ( getRates() < 0) {
+        return -1;
+    }
+
+    SnapshotGuard rates(m_rates);
+    double crossRate = rates->CrossRate(fromCurrency, toCurrency);
+    if (crossRate < 0) {
+        return -1;
+    }
+
+    Kernels::MultiplyChecked(amounts, crossRate, out, count);
+    return 0;
+}
+
+int RateManager::ConvertMany(const double *amounts, const CurrencyId *fromCurrencies,
+    const CurrencyId *toCurrencies, double *out, size_t count)
+{
+    if ( getRates() < 0) {
+        return -1;
+    }
+
+    SnapshotGuard rates(m_rates);
+    Kernels::GatherMultiply(amounts, fromCurrencies, toCurrencies, rates->CrossRates(), out, count);
+    return 0;
+}
+
+int RateManager::ConvertToAll(double amount, CurrencyId fromCurrency, double *out)
+{
+    if ( getRates() < 0) {
+        return -1;
+    }
+
+    SnapshotGuard rates(m_rates);
+    if (!rates->Available(fromCurrency) || amount < 0) {
+        return -1;
+    }
+
+    Kernels::MultiplyChecked(rates->CrossRatesFrom(fromCurrency), amount, out, MAX_CURRENCIES);
+    return 0;
+}
+
+int RateManager::ConvertFixed(MinorUnits amount, CurrencyId fromCurrency, CurrencyId toCurrency, MinorUnits *out)
+{
+    if ( getRates() < 0) {
+        return -1;
+    }
+
+    SnapshotGuard rates(m_rates);
+    return rates->Fixed().Convert(amount, fromCurrency, toCurrency, out);
+}
+
+int RateManager::ConvertManyFixed(const MinorUnits *amounts, MinorUnits *out, size_t count,
+    CurrencyId fromCurrency, CurrencyId toCurrency)
 {
     if ( getRates() < 0) {
+        return -1;
+    }
+
+    SnapshotGuard rates(m_rates);
+    return rates->Fixed().ConvertMany(amounts, out, count, fromCurrency, toCurrency);
+}
+
+long RateManager::ConvertLedger(const std::string &inFileName, const std::string &outFileName, unsigned numThreads)
+{
+    if ( getRates() < 0) {
+        return -1;
+    }
+
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // The whole ledger is converted with the same rates
+    SnapshotGuard rates(m_rates);
+    return ConvertLedgerFile(*rates.Get(), inFileName, outFileName, numThreads);
+}
+
+int RateManager::storeHistory()
+{
+    std::string historyFn = _getHistoryFileName();
+
+    if (m_history.Store(historyFn) < 0) {
+        std::cerr << "ERROR: Failed to store exchange rates history in " << historyFn << '\n';
+        return -1;
+    }
+
+    return 0;
+}
+
+int RateManager::ImportHistory(const std::string &xmlFileName)
+{
+    std::lock_guard<std::mutex> lock(m_historyLock);
+
+    m_analytics.reset();
+    if (m_history.ImportEcbXmlFile(xmlFileName) < 0) {
+        std::cerr << "ERROR: Failed to import exchange rates history from " << xmlFileName << '\n';
+        return -1;
+    }
+
+    m_historyLoaded = true;
+    archiveHistory();
+    return storeHistory();
+}
+
+int RateManager::FetchHistory()
+{
+    std::lock_guard<std::mutex> lock(m_historyLock);
+    return fetchHistory();
+}
+
+// Called with m_historyLock held
+int RateManager::fetchHistory()
+{
+    m_analytics.reset();
+    m_history.Clear();
+
+    HistoryXmlHandler handler(m_history);
+    EcbXmlParser parser(handler);
+    SourceFetch fetch = {};
+    fetch.parser = &parser;
+
+    RateSources sources;
+    sources.emplace_back(new HttpRateSource(EURO_FOREIGN_EXCHANGE_REFERENCE_RATES_HISTORY_LINK, HISTORY_TIMEOUT_MS));
+    if (FetchFirstDocument(sources, &fetch, NULL) < 0) {
+        m_history.Clear();
+        return -1;
+    }
+
+    handler.Finish();
+    m_historyLoaded = true;
+    archiveHistory();
+    return storeHistory();
+}
+
+int RateManager::ComputeWindowStats(const std::string &baseCurrency, const std::string &quoteCurrency,
+    int fromDay, int toDay, size_t window, WindowStats &stats)
+{
+    std::lock_guard<std::mutex> lock(m_historyLock);
+    if (getHistory(toDay) < 0 && m_history.Empty())
+        return -1;
+
+    CurrencyId baseId = CurrencyIdFromCode(baseCurrency.c_str(), baseCurrency.size());
+    if (baseId == INVALID_CURRENCY || (baseId != CURRENCY_EUR && !m_history.Column(baseId))) {
+        std::cerr << "ERROR: Could not find Currency " << baseCurrency << '\n';
+        return -1;
+    }
+
+    CurrencyId quoteId = CurrencyIdFromCode(quoteCurrency.c_str(), quoteCurrency.size());
+    if (quoteId == INVALID_CURRENCY || (quoteId != CURRENCY_EUR && !m_history.Column(quoteId))) {
+        std::cerr << "ERROR: Could not find Currency " << quoteCurrency << '\n';
+        return -1;
+    }
+
+    // Kept across queries: log rates of each currency are only computed once
+    if (!m_analytics)
+        m_analytics.reset(new WindowAnalytics(m_history));
+    return m_analytics->Compute(baseId, quoteId, fromDay, toDay, window, stats);
+}
+
+int RateManager::getHistory(int day)
+{
+    if (!m_historyLoaded) {
+        m_analytics.reset();
+        m_history.Load(_getHistoryFileName());
+        m_historyLoaded = true;
+    }
+
+    // Dates past the stored history need a newer one, unless ECB can't
+    // have published anything newer yet
+    bool outdated = m_history.Empty() ||
+        (day > m_history.LastDay() && m_history.LastDay() < getEcbLastUpdateTime() / NUM_SECONDS_DAY);
+    if (outdated && fetchHistory() < 0)
+        return -1;
+
+    return 0;
+}
+
+double RateManager::Convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency, time_t date)
+{
+    int day = date / NUM_SECONDS_DAY;
+
+    std::lock_guard<std::mutex> lock(m_historyLock);
+    if ( getHistory(day) < 0) {
+        return (double) -1;
+    }
+
+    if (m_history.DayIndex(day) < 0) {
+        char ecbDate[ECB_DATE_LEN + 1];
+        dayToEcbDate(day, ecbDate);
+        std::cerr << "ERROR: No exchange rates for " << ecbDate << '\n';
         return (double) -1;
     }
 
-    double toRate = CurrencyToRate(toCurrency);
+    double toRate = m_history.Rate(CurrencyIdFromCode(toCurrency.c_str(), toCurrency.size()), day);
     if (toRate < 0) {
         std::cerr << "ERROR: Could not find Currency " << toCurrency << '\n';
         return (double) -1;
     }
 
-    double fromRate = CurrencyToRate(fromCurrency);
+    double fromRate = m_history.Rate(CurrencyIdFromCode(fromCurrency.c_str(), fromCurrency.size()), day);
     if (fromRate < 0) {
         std::cerr << "ERROR: Could not find Currency " << fromCurrency << '\n';
         return (double) -1;
@@ -328,5 +718,6 @@ double RateManager::Convert(const double &amount, const std::string &fromCurrenc
 
 const time_t RateManager::GetRatesLastUpdatedDate()
 {
-    return m_lastUpdated;
+    SnapshotGuard rates(m_rates);
+    return rates.Get() ? rates->Date() : 0;
 }
\ No newline at end of file
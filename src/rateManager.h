@@ -20,35 +20,134 @@
 #ifndef CC_RATE_MANAGER_H
 #define CC_RATE_MANAGER_H
 
+#include "rateSnapshot.h"
+#include "rateHistory.h"
+#include "rateArchive.h"
+#include "windowAnalytics.h"
+#include "snapshotPublisher.h"
+#include "refreshScheduler.h"
+#include "rateSource.h"
+#include "sharedRates.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <iostream>
-#include <map>
 #include <string>
 #include <ctime>
 
 namespace CurrencyConverter {
 
-typedef std::map <std::string, double> CurrencyRatesTable;
-
+//
+// Conversions may run from any number of threads: they read immutable rate
+// snapshots without locking, while loads and refreshes publish new ones.
+//
 class RateManager {
 public:
+	// Managers are independent: each one loads and holds its own rates.
+	// The command line tool uses the process wide instance
+	RateManager();
+	~RateManager();
 	static RateManager& Instance();
+	int LoadRates();
+	// Reloads rates from the local cache, or from ECB if the cache is outdated.
+	// Current rates are kept if that fails
+	int RefreshRates();
+	// Keeps rates up to date from a background thread: conversions then
+	// serve the last good rates and never load or download anything
+	int StartBackgroundRefresh();
+	void StopBackgroundRefresh();
+	RefreshState GetRefreshState();
 	void ExtractRatesFromECBXml(void *buffer, size_t len);
 	double Convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency);
+	double Convert(double amount, CurrencyId fromCurrency, CurrencyId toCurrency);
+	// Converts at the reference rates of a past date (any time of that UTC day).
+	// The history is loaded from the local store, or fetched from ECB when
+	// the store does not exist or does not cover the date yet.
+	double Convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency, time_t date);
+	int ImportHistory(const std::string &xmlFileName);
+	int FetchHistory();
+	// Rolling statistics of a currency pair (see WindowAnalytics), over the
+	// history loaded or fetched like for conversions at a date. A stored
+	// history that can't be updated is used as is
+	int ComputeWindowStats(const std::string &baseCurrency, const std::string &quoteCurrency,
+		int fromDay, int toDay, size_t window, WindowStats &stats);
+
+	// Bulk conversions: amounts and out hold count values. Invalid elements
+	// are set to -1; -1 is returned when rates can't be loaded or, for the
+	// single pair variant, when the pair is unknown.
+	int ConvertMany(const double *amounts, double *out, size_t count,
+		CurrencyId fromCurrency, CurrencyId toCurrency);
+	int ConvertMany(const double *amounts, const CurrencyId *fromCurrencies,
+		const CurrencyId *toCurrencies, double *out, size_t count);
+	// Converts amount into every currency: out holds MAX_CURRENCIES values,
+	// indexed by currency ID, -1 for currencies without a rate
+	int ConvertToAll(double amount, CurrencyId fromCurrency, double *out);
+
+	// Exact conversions of amounts in minor units (see FixedRates), rounded
+	// half to even. Return -1 when rates can't be loaded, the pair is
+	// unknown or a result overflows
+	int ConvertFixed(MinorUnits amount, CurrencyId fromCurrency, CurrencyId toCurrency, MinorUnits *out);
+	int ConvertManyFixed(const MinorUnits *amounts, MinorUnits *out, size_t count,
+		CurrencyId fromCurrency, CurrencyId toCurrency);
+	// Converts a CSV ledger file (see ConvertLedgerFile) with numThreads
+	// threads, 0 for one per CPU. Returns the number of lines that could not
+	// be converted, -1 on failure
+	long ConvertLedger(const std::string &inFileName, const std::string &outFileName, unsigned numThreads);
 	const time_t GetRatesLastUpdatedDate();
+	// Adds a source of ECB documents (see CreateRateSource), tried instead
+	// of the ECB website. Returns -1 for unsupported specifications
+	int AddRateSource(const std::string &spec, unsigned timeoutMs);
+	// Adds the quotes of a file (see LoadRateQuotes) to every rates snapshot,
+	// current one included: they extend conversions beyond ECB currencies.
+	// Returns -1 if the file can't be loaded
+	int AddRateQuotes(const std::string &fileName);
+	// Shares rates with the other processes of the user (see
+	// SharedRateTable): rates are taken from there when up to date, and
+	// rates loaded or downloaded are published there. Returns -1 if the
+	// shared memory can't be set up
+	int EnableSharedRates();
+	// Appends every rates downloaded or history imported or fetched from
+	// now on to the local archive (see RateArchive). Returns -1 if the
+	// archive can't be opened
+	int EnableArchive();
+	// Loads the archived rates from fromDay to toDay included. Returns -1
+	// if there is no archive or if it can't be read
+	int LoadArchive(int fromDay, int toDay, RateHistory &history);
 
 private:
-	RateManager();
-	~RateManager();
+	RateManager(const RateManager &);
+	RateManager& operator=(const RateManager &);
 	int getRates();
-	int getStoredRates();
+	double convert(const double &amount, const std::string &fromCurrency, const std::string &toCurrency);
+	int loadRates();
+	int refreshRates();
+	int getStoredRates(bool acceptOutdated);
 	int getECBRates();
-	void storeECBRates();
-	void storedECBUpdateTime();
-	double CurrencyToRate(const std::string &currencyCode);
-	bool storedRatesUpToDate();
+	int storeECBRates(const RateSnapshot &rates);
+	void publishRates(RateSnapshot *rates);
+	bool storedRatesUpToDate(time_t storedUpdateTime);
+	int getHistory(int day);
+	int storeHistory();
+	int fetchHistory();
+	void archiveRates(const RateSnapshot &rates);
+	void archiveHistory();
 
-	CurrencyRatesTable m_rates;
-	time_t m_lastUpdated;
+	RateSources m_sources;		// ECB website if none was added
+	std::vector<RateQuote> m_quotes;	// Under m_refreshLock
+	std::unique_ptr<SharedRateTable> m_sharedRates;	// NULL unless enabled
+	SnapshotPublisher m_rates;
+	std::atomic<bool> m_ratesLoaded;
+	std::mutex m_refreshLock;	// Serializes rates loads and refreshes
+	RateHistory m_history;
+	bool m_historyLoaded;
+	// Log rates cache of m_history: NULL until a statistics query, and
+	// whenever m_history changes. Both under m_historyLock
+	std::unique_ptr<WindowAnalytics> m_analytics;
+	std::mutex m_historyLock;
+	std::unique_ptr<RateArchive> m_archive;	// NULL unless enabled
+	std::mutex m_archiveLock;
+	// Last member: its thread uses the others until it is destroyed
+	std::unique_ptr<RefreshScheduler> m_scheduler;
 	static RateManager m_instance;
 };
 } // namespace CurrencyConverter
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rateSnapshot.h"
+
+using namespace CurrencyConverter;
+
+RateSnapshot::RateSnapshot()
+{
+    Clear();
+}
+
+void RateSnapshot::Clear()
+{
+    for (size_t i = 0; i < MAX_CURRENCIES; i++) {
+        m_rates[i] = -1;
+        for (size_t j = 0; j < MAX_CURRENCIES; j++)
+            m_crossRates[i][j] = -1;
+    }
+
+    // EUR is the reference currency: it is never part of ECB tables
+    m_rates[CURRENCY_EUR] = 1;
+    m_fixedRates.Clear();
+    m_numQuotes = 0;
+    m_count = 0;
+    m_date = 0;
+}
+
+void RateSnapshot::SetRate(CurrencyId id, double rate)
+{
+    if (id >= MAX_CURRENCIES || id == CURRENCY_EUR || rate <= 0)
+        return;
+
+    if (m_rates[id] <= 0)
+        m_count++;
+    m_rates[id] = rate;
+}
+
+int RateSnapshot::SetQuotes(const RateQuote *quotes, size_t count)
+{
+    m_numQuotes = 0;
+    for (size_t i = 0; i < count && m_numQuotes < MAX_QUOTES; i++) {
+        const RateQuote &quote = quotes[i];
+        if (quote.base < MAX_CURRENCIES && quote.quote < MAX_CURRENCIES && quote.base != quote.quote
+            && quote.rate > 0)
+            m_quotes[m_numQuotes++] = quote;
+    }
+
+    return (m_numQuotes == count) ? 0 : -1;
+}
+
+void RateSnapshot::BuildCrossRates()
+{
+    for (size_t from = 0; from < MAX_CURRENCIES; from++) {
+        for (size_t to = 0; to < MAX_CURRENCIES; to++) {
+            if (m_rates[from] > 0 && m_rates[to] > 0)
+                m_crossRates[from][to] = m_rates[to] / m_rates[from];
+            else
+                m_crossRates[from][to] = -1;
+        }
+    }
+
+    if (m_numQuotes > 0)
+        buildQuotePaths();
+
+    m_fixedRates.Build(m_rates);
+}
+
+// Floyd-Warshall step for one row: paths from a vertex through another
+// one, "via", replace the current ones when they have fewer hops.
+// Branch free: which paths improve is unpredictable
+static inline void _relaxRow(int32_t *__restrict hops, double *__restrict rates,
+    const int32_t *__restrict viaHops, const double *__restrict viaRates,
+    int32_t hopsToVia, double rateToVia, size_t n)
+{
+    for (size_t j = 0; j < n; j++) {
+        int32_t pathHops = hopsToVia + viaHops[j];
+        double pathRate = rateToVia * viaRates[j];
+        bool shorter = pathHops < hops[j];
+        hops[j] = shorter ? pathHops : hops[j];
+        rates[j] = shorter ? pathRate : rates[j];
+    }
+}
+
+// Rates are the edges of a graph over the currencies, both ways: ECB rates
+// link each currency to EUR, and quotes link their two currencies. Floyd-
+// Warshall over the currencies in use finds the paths with the fewest hops;
+// on ties, the triangulation through EUR already in the matrix is kept.
+// Quotes between two ECB currencies are left out, so pairs of ECB
+// currencies always keep their ECB rates: at most two hops through EUR,
+// which no path without such a quote beats.
+// O(n^3) once per snapshot, so that conversions remain a lookup
+void RateSnapshot::buildQuotePaths()
+{
+    // Never reached by a sum of two hop counts below it
+    static const int32_t NO_PATH = 1 << 20;
+
+    bool used[MAX_CURRENCIES] = {};
+    for (size_t id = 0; id < MAX_CURRENCIES; id++)
+        used[id] = m_rates[id] > 0;
+    for (size_t i = 0; i < m_numQuotes; i++)
+        used[m_quotes[i].base] = used[m_quotes[i].quote] = true;
+
+    // Works on the matrices of the vertices only, rows contiguous
+    CurrencyId vertices[MAX_CURRENCIES];
+    uint8_t index[MAX_CURRENCIES];
+    size_t n = 0;
+    for (size_t id = 0; id < MAX_CURRENCIES; id++) {
+        if (used[id]) {
+            index[id] = n;
+            vertices[n++] = static_cast<CurrencyId>(id);
+        }
+    }
+
+    int32_t hops[MAX_CURRENCIES][MAX_CURRENCIES];
+    double rates[MAX_CURRENCIES][MAX_CURRENCIES];
+
+    // Paths through EUR: one hop from or to EUR, two otherwise
+    for (size_t i = 0; i < n; i++) {
+        CurrencyId from = vertices[i];
+        for (size_t j = 0; j < n; j++) {
+            CurrencyId to = vertices[j];
+            rates[i][j] = (i == j) ? 1 : m_crossRates[from][to];
+            if (i == j)
+                hops[i][j] = 0;
+            else if (rates[i][j] > 0)
+                hops[i][j] = (from == CURRENCY_EUR || to == CURRENCY_EUR) ? 1 : 2;
+            else
+                hops[i][j] = NO_PATH;
+        }
+    }
+
+    // The first quote of a pair wins
+    for (size_t q = 0; q < m_numQuotes; q++) {
+        if (m_rates[m_quotes[q].base] > 0 && m_rates[m_quotes[q].quote] > 0)
+            continue;
+        size_t base = index[m_quotes[q].base], quote = index[m_quotes[q].quote];
+        if (hops[base][quote] > 1) {
+            hops[base][quote] = hops[quote][base] = 1;
+            rates[base][quote] = m_quotes[q].rate;
+            rates[quote][base] = 1 / m_quotes[q].rate;
+        }
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        for (size_t i = 0; i < n; i++) {
+            if (i != k && hops[i][k] != NO_PATH)
+                _relaxRow(hops[i], rates[i], hops[k], rates[k], hops[i][k], rates[i][k], n);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++)
+            m_crossRates[vertices[i]][vertices[j]] = rates[i][j];
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_RATE_SNAPSHOT_H
+#define CC_RATE_SNAPSHOT_H
+
+#include "currency.h"
+#include "fixedRates.h"
+#include <ctime>
+
+namespace CurrencyConverter {
+
+// A rate from another source than ECB: 1 base = rate quote
+struct RateQuote {
+	CurrencyId base;
+	CurrencyId quote;
+	double rate;
+};
+
+//
+// One day of reference rates, indexed by currency ID.
+// Rates are expressed against EUR, like ECB publishes them. Once all rates
+// are set, BuildCrossRates() precomputes the full cross rates matrix so a
+// conversion is a table lookup plus one multiply, and the fixed point
+// rates for exact conversions of minor units.
+//
+// Quotes of other sources, with any base, extend the matrix: rates are then
+// the edges of a currency graph and each pair is converted along its path
+// with the fewest hops. They only serve to reach currencies ECB does not
+// publish: pairs of ECB currencies keep their ECB rates, and quotes between
+// two of them are ignored. Fixed point conversions only use the ECB rates.
+//
+class RateSnapshot {
+public:
+	RateSnapshot();
+	void Clear();
+	void SetRate(CurrencyId id, double rate);
+	// Replaces the quotes. Returns -1 if some are invalid or beyond
+	// MAX_QUOTES: they are left out
+	int SetQuotes(const RateQuote *quotes, size_t count);
+	void BuildCrossRates();
+
+	// Rate of currency against EUR, negative if the currency is not available
+	double Rate(CurrencyId id) const
+	{
+		return (id < MAX_CURRENCIES) ? m_rates[id] : -1;
+	}
+
+	// Multiplier converting an amount from one currency into another,
+	// negative if either currency is not available
+	double CrossRate(CurrencyId from, CurrencyId to) const
+	{
+		return (from < MAX_CURRENCIES && to < MAX_CURRENCIES) ? m_crossRates[from][to] : -1;
+	}
+
+	bool HasRate(CurrencyId id) const { return Rate(id) > 0; }
+	// The currency has an ECB rate or a quote: it converts to itself
+	bool Available(CurrencyId id) const { return CrossRate(id, id) > 0; }
+
+	// Row major MAX_CURRENCIES x MAX_CURRENCIES cross rates matrix, and one
+	// of its rows: the rates to convert from one currency into every other
+	const double *CrossRates() const { return &m_crossRates[0][0]; }
+	const double *CrossRatesFrom(CurrencyId from) const { return m_crossRates[from]; }
+
+	const FixedRates &Fixed() const { return m_fixedRates; }
+
+	// Number of published rates, EUR excluded
+	bool Empty() const { return m_count == 0; }
+	size_t Count() const { return m_count; }
+
+	time_t Date() const { return m_date; }
+	void SetDate(time_t date) { m_date = date; }
+
+	static const size_t MAX_QUOTES = 256;
+
+private:
+	void buildQuotePaths();
+
+	double m_rates[MAX_CURRENCIES];
+	double m_crossRates[MAX_CURRENCIES][MAX_CURRENCIES];
+	FixedRates m_fixedRates;
+	RateQuote m_quotes[MAX_QUOTES];
+	size_t m_numQuotes;
+	size_t m_count;
+	time_t m_date;
+};
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,429 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rateSource.h"
+#include "lazyLibraries.h"
+#include "metrics.h"
+#include "utils.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+using namespace CurrencyConverter;
+
+static const char FILE_URL_PREFIX[] = "file://";
+static const char XML_SUFFIX[] = ".xml";
+
+// Upper bound of a wait for download progress, in milliseconds
+static const int MULTI_WAIT_MS = 1000;
+
+static const long HTTP_NOT_MODIFIED = 304;
+
+static bool _startsWith(const std::string &s, const char *prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+RateSource::RateSource(const std::string &location, unsigned timeoutMs) :
+    m_location(location),
+    m_timeoutMs(timeoutMs)
+{
+}
+
+HttpRateSource::HttpRateSource(const std::string &url, unsigned timeoutMs) :
+    RateSource(url, timeoutMs)
+{
+}
+
+int HttpRateSource::Read(EcbXmlParser &) const
+{
+    // Downloads are driven by FetchFirstDocument
+    return -1;
+}
+
+FileRateSource::FileRateSource(const std::string &fileName) :
+    RateSource(fileName, 0)
+{
+}
+
+int FileRateSource::Read(EcbXmlParser &parser) const
+{
+    return parser.FeedFile(Location());
+}
+
+DirectoryRateSource::DirectoryRateSource(const std::string &dirName) :
+    RateSource(dirName, 0)
+{
+}
+
+int DirectoryRateSource::Read(EcbXmlParser &parser) const
+{
+    DIR *dir = opendir(Location().c_str());
+    if (!dir)
+        return -1;
+
+    std::string newest;
+    struct timespec newestTime = {};
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= strlen(XML_SUFFIX) || strcmp(entry->d_name + len - strlen(XML_SUFFIX), XML_SUFFIX))
+            continue;
+
+        std::string fileName = Location() + "/" + entry->d_name;
+        struct stat st;
+        if (stat(fileName.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (newest.empty() || st.st_mtim.tv_sec > newestTime.tv_sec ||
+            (st.st_mtim.tv_sec == newestTime.tv_sec && st.st_mtim.tv_nsec > newestTime.tv_nsec)) {
+            newest = fileName;
+            newestTime = st.st_mtim;
+        }
+    }
+    closedir(dir);
+
+    if (newest.empty())
+        return -1;
+
+    return parser.FeedFile(newest);
+}
+
+RateSource *CurrencyConverter::CreateRateSource(const std::string &spec, unsigned timeoutMs)
+{
+    if (_startsWith(spec, "http://") || _startsWith(spec, "https://"))
+        return new HttpRateSource(spec, timeoutMs);
+
+    std::string path = spec;
+    if (_startsWith(spec, FILE_URL_PREFIX))
+        path = spec.substr(strlen(FILE_URL_PREFIX));
+    else if (spec.find("://") != std::string::npos)
+        return NULL;
+
+    if (path.empty())
+        return NULL;
+
+    // A directory that does not exist yet is taken for a file
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        return new DirectoryRateSource(path);
+
+    return new FileRateSource(path);
+}
+
+int CurrencyConverter::LoadSourceValidators(const std::string &fileName, SourceValidators &validators)
+{
+    validators.clear();
+
+    FILE *in = fopen(fileName.c_str(), "r");
+    if (!in)
+        return -1;
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, in)) > 0) {
+        if (line[len - 1] == '\n')
+            line[--len] = '\0';
+
+        char *etag = strchr(line, '\t');
+        char *lastModified = etag ? strchr(etag + 1, '\t') : NULL;
+        if (!lastModified)
+            continue;
+        *etag++ = '\0';
+        *lastModified++ = '\0';
+
+        DocumentValidators &entry = validators[line];
+        entry.etag = etag;
+        entry.lastModified = lastModified;
+    }
+    free(line);
+    fclose(in);
+
+    return 0;
+}
+
+int CurrencyConverter::StoreSourceValidators(const std::string &fileName, const SourceValidators &validators)
+{
+    return _writeFileAtomically(fileName, [&validators](FILE *out) {
+        for (SourceValidators::const_iterator it = validators.begin(); it != validators.end(); ++it) {
+            fprintf(out, "%s\t%s\t%s\n", it->first.c_str(), it->second.etag.c_str(),
+                it->second.lastModified.c_str());
+        }
+    });
+}
+
+// One download of FetchFirstDocument
+struct Transfer {
+    CURL *curl;
+    size_t source;      // Index in sources
+    SourceFetch *fetch;
+    struct curl_slist *headers;     // Conditional request headers
+    DocumentValidators received;    // From the response headers
+    uint64_t parseNs;   // Time spent parsing, out of the download time
+};
+
+// If line is the header name, sets value to its value
+static void _headerValue(const char *line, size_t len, const char *name, std::string *value)
+{
+    size_t nameLen = strlen(name);
+    if (len <= nameLen || line[nameLen] != ':' || strncasecmp(line, name, nameLen))
+        return;
+
+    const char *begin = line + nameLen + 1;
+    const char *end = line + len;
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+        begin++;
+    while (end > begin && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' '))
+        end--;
+    value->assign(begin, end - begin);
+}
+
+static size_t _parseHeader(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    Transfer *transfer = (Transfer *) userp;
+    size_t len = size * nitems;
+
+    // Each response (an interim 100 Continue for instance) starts over
+    if (len >= 5 && !strncmp(buffer, "HTTP/", 5))
+        transfer->received = DocumentValidators();
+
+    _headerValue(buffer, len, "ETag", &transfer->received.etag);
+    _headerValue(buffer, len, "Last-Modified", &transfer->received.lastModified);
+    return len;
+}
+
+static size_t _parseReceived(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+    Transfer *transfer = (Transfer *) userp;
+
+    uint64_t start = Metrics::Now();
+    int ret = transfer->fetch->parser->Feed((const char *) buffer, size * nmemb);
+    transfer->parseNs += Metrics::Now() - start;
+
+    // Returning less than the received size aborts the transfer
+    if (ret < 0)
+        return 0;
+
+    return size * nmemb;
+}
+
+static int _readLocalSources(const RateSources &sources, SourceFetch *fetches, uint64_t *parseNs)
+{
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i]->Remote())
+            continue;
+
+        uint64_t start = Metrics::Now();
+        int ret = sources[i]->Read(*fetches[i].parser);
+        if (ret == 0)
+            ret = fetches[i].parser->Finish();
+        *parseNs = Metrics::Now() - start;
+
+        if (ret == 0)
+            return i;
+
+        std::cerr << "ERROR: Failed to read exchange rates from " << sources[i]->Location() << '\n';
+    }
+
+    return -1;
+}
+
+static int _downloadRemoteSources(const RateSources &sources, SourceFetch *fetches, uint64_t *parseNs)
+{
+    std::vector<Transfer> transfers;
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i]->Remote())
+            transfers.push_back(Transfer { NULL, i, &fetches[i], NULL, DocumentValidators(), 0 });
+    }
+    if (transfers.empty())
+        return -1;
+
+    // libcurl is only loaded now that a download is needed
+    const CurlLibrary *curlLib = Curl();
+    if (!curlLib)
+        return -1;
+
+    CURLM *multi = curlLib->multi_init();
+    if (!multi)
+        return -1;
+
+    for (size_t t = 0; t < transfers.size(); t++) {
+        Transfer &transfer = transfers[t];
+        const RateSource &source = *sources[transfer.source];
+        transfer.curl = curlLib->easy_init();
+        if (!transfer.curl)
+            continue;
+
+        curlLib->easy_setopt(transfer.curl, CURLOPT_URL, source.Location().c_str());
+        curlLib->easy_setopt(transfer.curl, CURLOPT_WRITEFUNCTION, _parseReceived);
+        curlLib->easy_setopt(transfer.curl, CURLOPT_WRITEDATA, &transfer);
+        curlLib->easy_setopt(transfer.curl, CURLOPT_HEADERFUNCTION, _parseHeader);
+        curlLib->easy_setopt(transfer.curl, CURLOPT_HEADERDATA, &transfer);
+        curlLib->easy_setopt(transfer.curl, CURLOPT_PRIVATE, &transfer);
+        // Every encoding libcurl can decode is accepted: gzip at least
+        curlLib->easy_setopt(transfer.curl, CURLOPT_ACCEPT_ENCODING, "");
+
+        // Only get the document if it changed since the cached one
+        const DocumentValidators &validators = transfer.fetch->validators;
+        if (!validators.etag.empty()) {
+            std::string header = "If-None-Match: " + validators.etag;
+            transfer.headers = curlLib->slist_append(transfer.headers, header.c_str());
+        }
+        if (!validators.lastModified.empty()) {
+            std::string header = "If-Modified-Since: " + validators.lastModified;
+            transfer.headers = curlLib->slist_append(transfer.headers, header.c_str());
+        }
+        if (transfer.headers)
+            curlLib->easy_setopt(transfer.curl, CURLOPT_HTTPHEADER, transfer.headers);
+
+        curlLib->easy_setopt(transfer.curl, CURLOPT_TIMEOUT_MS, (long) source.TimeoutMs());
+        // HTTP errors fail the transfer instead of delivering an error page
+        curlLib->easy_setopt(transfer.curl, CURLOPT_FAILONERROR, 1L);
+        // Timeouts must not rely on signals: other threads may be running
+        curlLib->easy_setopt(transfer.curl, CURLOPT_NOSIGNAL, 1L);
+        curlLib->multi_add_handle(multi, transfer.curl);
+    }
+
+    int winner = -1;
+    int running = 1;
+    while (winner < 0 && running > 0) {
+        if (curlLib->multi_perform(multi, &running) != CURLM_OK)
+            break;
+
+        CURLMsg *msg;
+        int queued;
+        while (winner < 0 && (msg = curlLib->multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+
+            Transfer *transfer;
+            curlLib->easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &transfer);
+            const RateSource &source = *sources[transfer->source];
+
+            if (msg->data.result != CURLE_OK) {
+                std::cerr << "ERROR: Failed to get exchange rates from " << source.Location() << ": " <<
+                    curlLib->easy_strerror(msg->data.result) << '\n';
+                continue;
+            }
+
+            long responseCode = 0;
+            curlLib->easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &responseCode);
+            if (responseCode == HTTP_NOT_MODIFIED) {
+                // Nothing to parse: the cached document is still current
+                transfer->fetch->notModified = true;
+                winner = transfer->source;
+                *parseNs = 0;
+                continue;
+            }
+
+            uint64_t start = Metrics::Now();
+            int ret = transfer->fetch->parser->Finish();
+            transfer->parseNs += Metrics::Now() - start;
+            if (ret < 0) {
+                std::cerr << "ERROR: Failed to parse exchange rates from " << source.Location() << '\n';
+                continue;
+            }
+
+            transfer->fetch->validators = transfer->received;
+            winner = transfer->source;
+            *parseNs = transfer->parseNs;
+        }
+
+        if (winner < 0 && running > 0)
+            curlLib->multi_wait(multi, NULL, 0, MULTI_WAIT_MS, NULL);
+    }
+
+    // Aborts the transfers still running
+    for (size_t t = 0; t < transfers.size(); t++) {
+        if (!transfers[t].curl)
+            continue;
+
+        curl_off_t received = 0;
+        if (curlLib->easy_getinfo(transfers[t].curl, CURLINFO_SIZE_DOWNLOAD_T, &received) == CURLE_OK)
+            Metrics::Increment(COUNTER_ECB_BYTES_RECEIVED, received);
+
+        curlLib->multi_remove_handle(multi, transfers[t].curl);
+        curlLib->easy_cleanup(transfers[t].curl);
+        curlLib->slist_free_all(transfers[t].headers);
+    }
+    curlLib->multi_cleanup(multi);
+
+    return winner;
+}
+
+int CurrencyConverter::FetchFirstDocument(const RateSources &sources, SourceFetch *fetches, uint64_t *parseNs)
+{
+    uint64_t winnerParseNs = 0;
+
+    for (size_t i = 0; i < sources.size(); i++)
+        fetches[i].notModified = false;
+
+    int winner = _readLocalSources(sources, fetches, &winnerParseNs);
+    if (winner < 0)
+        winner = _downloadRemoteSources(sources, fetches, &winnerParseNs);
+
+    if (parseNs)
+        *parseNs = winnerParseNs;
+    return winner;
+}
+
+int CurrencyConverter::LoadRateQuotes(const std::string &fileName, std::vector<RateQuote> &quotes)
+{
+    FILE *in = fopen(fileName.c_str(), "r");
+    if (!in) {
+        std::cerr << "ERROR: Failed to open " << fileName << '\n';
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    int lineNumber = 0;
+    int ret = 0;
+    while (getline(&line, &size, in) > 0) {
+        lineNumber++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char base[8], quote[8], end;
+        RateQuote rateQuote;
+        int fields = sscanf(line, " %7s %7s %lf %c", base, quote, &rateQuote.rate, &end);
+        if (fields <= 0)
+            continue;
+
+        rateQuote.base = InternCurrency(base, strlen(base));
+        rateQuote.quote = InternCurrency(quote, strlen(quote));
+        if (fields != 3 || rateQuote.base == INVALID_CURRENCY || rateQuote.quote == INVALID_CURRENCY
+            || rateQuote.base == rateQuote.quote || !(rateQuote.rate > 0)) {
+            std::cerr << "ERROR: Invalid quote at " << fileName << ':' << lineNumber << '\n';
+            ret = -1;
+            break;
+        }
+        quotes.push_back(rateQuote);
+    }
+    free(line);
+    fclose(in);
+
+    return ret;
+}
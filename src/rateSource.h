@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_RATE_SOURCE_H
+#define CC_RATE_SOURCE_H
+
+#include "ecbXmlParser.h"
+#include "rateSnapshot.h"
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace CurrencyConverter {
+
+//
+// Where ECB documents come from: the ECB website by default, but also
+// mirrors, a local file or a directory where another process drops them.
+// Sources are either local, read right away, or remote, downloaded.
+//
+class RateSource {
+public:
+	virtual ~RateSource() {}
+
+	const std::string &Location() const { return m_location; }
+	// Remote sources only: the whole download must complete within it
+	unsigned TimeoutMs() const { return m_timeoutMs; }
+	// True for sources to download (see FetchFirstDocument)
+	virtual bool Remote() const = 0;
+	// Local sources only: feeds their document to parser, without
+	// finishing it. Returns -1 if it can't be read or parsed
+	virtual int Read(EcbXmlParser &parser) const = 0;
+
+protected:
+	RateSource(const std::string &location, unsigned timeoutMs);
+
+private:
+	RateSource(const RateSource &);
+	RateSource& operator=(const RateSource &);
+
+	std::string m_location;
+	unsigned m_timeoutMs;
+};
+
+// An http:// or https:// URL
+class HttpRateSource : public RateSource {
+public:
+	HttpRateSource(const std::string &url, unsigned timeoutMs);
+	bool Remote() const { return true; }
+	int Read(EcbXmlParser &parser) const;
+};
+
+// A local file, updated in place
+class FileRateSource : public RateSource {
+public:
+	explicit FileRateSource(const std::string &fileName);
+	bool Remote() const { return false; }
+	int Read(EcbXmlParser &parser) const;
+};
+
+// A directory where documents are dropped: the most recently modified
+// *.xml file is used
+class DirectoryRateSource : public RateSource {
+public:
+	explicit DirectoryRateSource(const std::string &dirName);
+	bool Remote() const { return false; }
+	int Read(EcbXmlParser &parser) const;
+};
+
+typedef std::vector<std::unique_ptr<RateSource>> RateSources;
+
+static const unsigned DEFAULT_SOURCE_TIMEOUT_MS = 30000;
+static const unsigned MAX_SOURCE_TIMEOUT_MS = 3600000;
+
+// HTTP validators of a document: sent back to only get it if it changed
+struct DocumentValidators {
+	std::string etag;		// ETag, sent in If-None-Match
+	std::string lastModified;	// Last-Modified, sent in If-Modified-Since
+
+	bool Empty() const { return etag.empty() && lastModified.empty(); }
+};
+
+// Validators by source location
+typedef std::map<std::string, DocumentValidators> SourceValidators;
+
+// Validators are kept in a text file, one "<location>\t<etag>\t<last modified>"
+// line per source. Load returns -1 if the file can't be read, Store if it
+// can't be written; it is replaced atomically
+int LoadSourceValidators(const std::string &fileName, SourceValidators &validators);
+int StoreSourceValidators(const std::string &fileName, const SourceValidators &validators);
+
+// What FetchFirstDocument gets from, and reports on, each source
+struct SourceFetch {
+	EcbXmlParser *parser;		// Receives the document
+	// In: validators of the locally cached document, if any. Downloads are
+	// then conditional. Out: validators of the winning document
+	DocumentValidators validators;
+	bool notModified;		// Out: the cached document is current (HTTP 304)
+};
+
+// Creates the source of an http(s):// URL, a file:// URL or a path, to a
+// file or a directory. Returns NULL for other URL schemes
+RateSource *CreateRateSource(const std::string &spec, unsigned timeoutMs);
+
+//
+// Gets a document from the first source that delivers a valid one, fed
+// to fetches[i].parser for sources[i] and finished. Local sources are read
+// first, in order, since they answer at once; then remote sources are
+// downloaded concurrently, each within its timeout, and parsed as they are
+// received. Downloads accept gzip encoding. The first download completing
+// with a well formed document, or with 304 Not Modified, wins and the
+// others are aborted.
+//
+// Returns the index of the winning source, -1 if none delivered. If
+// parseNs is not NULL, it is set to the time spent parsing the winner.
+//
+int FetchFirstDocument(const RateSources &sources, SourceFetch *fetches, uint64_t *parseNs);
+
+// Rates of other sources than ECB, e.g. other central banks, with any
+// base: a text file of "<base> <quote> <rate>" lines (1 base = rate quote),
+// '#' starting a comment. Currencies ECB never published are interned.
+// Returns -1 if the file can't be read or a line is invalid
+int LoadRateQuotes(const std::string &fileName, std::vector<RateQuote> &quotes);
+
+} // namespace CurrencyConverter
+
+#endif
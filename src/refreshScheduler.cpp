@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "refreshScheduler.h"
+#include "rateManager.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace CurrencyConverter;
+
+// Retry delays after failed attempts: 30s, 1min, 2min... up to 30min
+static const time_t RETRY_DELAY_MIN_SEC = 30;
+static const time_t RETRY_DELAY_MAX_SEC = 30 * 60;
+
+RefreshScheduler::RefreshScheduler(RateManager &rr)
+    : m_rr(rr), m_state(), m_stop(false)
+{
+}
+
+RefreshScheduler::~RefreshScheduler()
+{
+    Stop();
+}
+
+void RefreshScheduler::Start()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_state.running)
+        return;
+
+    m_stop = false;
+    m_state.running = true;
+    // First refresh right away: the rates in use may already be outdated
+    m_state.nextScheduled = time(NULL);
+    m_thread = std::thread(&RefreshScheduler::run, this);
+}
+
+void RefreshScheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_state.running)
+            return;
+        m_stop = true;
+    }
+
+    m_wakeUp.notify_all();
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_state.running = false;
+}
+
+RefreshState RefreshScheduler::State()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    RefreshState state = m_state;
+    state.ratesDate = m_rr.GetRatesLastUpdatedDate();
+    return state;
+}
+
+void RefreshScheduler::refresh()
+{
+    time_t now = time(NULL);
+
+    // Only refresh when ECB has published rates newer than ours
+    bool upToDate = m_rr.GetRatesLastUpdatedDate() >= getEcbLastUpdateTime();
+    if (!upToDate) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_state.lastAttempt = now;
+        }
+        // ECB may publish a bit late: getting yesterday's rates again is a failure
+        upToDate = m_rr.RefreshRates() == 0 && m_rr.GetRatesLastUpdatedDate() >= getEcbLastUpdateTime();
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (upToDate) {
+        if (m_state.lastAttempt == now)
+            m_state.lastSuccess = now;
+        m_state.consecutiveFailures = 0;
+        m_state.nextScheduled = getEcbNextUpdateTime();
+    } else {
+        time_t delay = RETRY_DELAY_MIN_SEC << std::min(m_state.consecutiveFailures, 10u);
+        m_state.consecutiveFailures++;
+        m_state.nextScheduled = now + std::min(delay, RETRY_DELAY_MAX_SEC);
+    }
+}
+
+void RefreshScheduler::run()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (!m_stop) {
+        std::chrono::system_clock::time_point next =
+            std::chrono::system_clock::from_time_t(m_state.nextScheduled);
+        if (m_wakeUp.wait_until(lock, next, [this] { return m_stop; }))
+            break;
+
+        lock.unlock();
+        refresh();
+        lock.lock();
+    }
+}
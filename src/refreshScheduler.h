@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_REFRESH_SCHEDULER_H
+#define CC_REFRESH_SCHEDULER_H
+
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+namespace CurrencyConverter {
+
+class RateManager;
+
+// State of the background refresh, times are UTC time_t (0: never)
+struct RefreshState {
+	bool running;
+	time_t lastAttempt;		// Last refresh attempt
+	time_t lastSuccess;		// Last refresh that got the expected rates
+	time_t nextScheduled;		// Next refresh attempt
+	time_t ratesDate;		// ECB date of the rates being served
+	unsigned consecutiveFailures;
+};
+
+//
+// Keeps rates fresh from a background thread, so conversions never wait
+// on the network. A refresh is scheduled at each ECB publication time;
+// when it fails, or ECB has not published yet, it is retried with an
+// exponential backoff. Conversions keep using the last good snapshot
+// meanwhile: staleness is bounded by the maximum backoff.
+//
+class RefreshScheduler {
+public:
+	explicit RefreshScheduler(RateManager &rr);
+	~RefreshScheduler();
+
+	void Start();
+	void Stop();
+	RefreshState State();
+
+private:
+	RefreshScheduler(const RefreshScheduler &);
+	RefreshScheduler& operator=(const RefreshScheduler &);
+
+	void run();
+	void refresh();
+
+	RateManager &m_rr;
+	std::thread m_thread;
+	std::mutex m_lock;		// Protects m_state and m_stop
+	std::condition_variable m_wakeUp;
+	RefreshState m_state;
+	bool m_stop;
+};
+
+} // namespace CurrencyConverter
+
+#endif
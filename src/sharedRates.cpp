@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sharedRates.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CurrencyConverter;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared rates need lock free atomics");
+
+// A writer only updates a few hundred bytes: readers finding it still
+// busy after that many attempts assume it died and give up
+static const int MAX_READ_ATTEMPTS = 1000;
+
+SharedRateTable::SharedRateTable() :
+    m_fd(-1),
+    m_segment(NULL)
+{
+}
+
+SharedRateTable::~SharedRateTable()
+{
+    if (m_segment)
+        munmap(m_segment, sizeof(SharedRatesSegment));
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+int SharedRateTable::Open(const std::string &name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return -1;
+
+    // The creator sizes the segment, zero filled: no rates yet. Growing it
+    // is harmless if another process just did
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        ((size_t) st.st_size < sizeof(SharedRatesSegment) && ftruncate(fd, sizeof(SharedRatesSegment)) < 0)) {
+        close(fd);
+        return -1;
+    }
+
+    void *segment = mmap(NULL, sizeof(SharedRatesSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    m_fd = fd;
+    m_segment = (SharedRatesSegment *) segment;
+    return 0;
+}
+
+int SharedRateTable::Read(RateSnapshot &rates) const
+{
+    if (!m_segment)
+        return -1;
+
+    // The header is written once, before the first rates
+    if (m_segment->version.load(std::memory_order_acquire) != SHARED_RATES_VERSION ||
+        memcmp(m_segment->magic, SHARED_RATES_MAGIC, sizeof(SHARED_RATES_MAGIC)))
+        return -1;
+
+    uint64_t bits[MAX_CURRENCIES];
+    int64_t ecbDate;
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        uint64_t sequence = m_segment->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            sched_yield();
+            continue;
+        }
+
+        ecbDate = m_segment->ecbDate.load(std::memory_order_relaxed);
+        for (size_t id = 0; id < MAX_CURRENCIES; id++)
+            bits[id] = m_segment->rates[id].load(std::memory_order_relaxed);
+
+        // The copies must not be reordered after the check
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_segment->sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        if (ecbDate == 0)
+            return -1;
+
+        rates.Clear();
+        for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+            double rate;
+            memcpy(&rate, &bits[id], sizeof(rate));
+            if (bits[id])
+                rates.SetRate(id, rate);
+        }
+        rates.SetDate(ecbDate);
+        return rates.Empty() ? -1 : 0;
+    }
+
+    return -1;
+}
+
+int SharedRateTable::Write(const RateSnapshot &rates)
+{
+    if (!m_segment || rates.Empty())
+        return -1;
+
+    // Serializes writers. Unlike a lock in the segment, it is released if
+    // the writer dies
+    if (flock(m_fd, LOCK_EX) < 0)
+        return -1;
+
+    SharedRatesSegment *segment = m_segment;
+    uint32_t version = segment->version.load(std::memory_order_relaxed);
+    if (version == 0) {
+        // First writer: readers don't look at the magic before the version
+        memcpy(segment->magic, SHARED_RATES_MAGIC, sizeof(SHARED_RATES_MAGIC));
+        segment->version.store(SHARED_RATES_VERSION, std::memory_order_release);
+    } else if (version != SHARED_RATES_VERSION ||
+        memcmp(segment->magic, SHARED_RATES_MAGIC, sizeof(SHARED_RATES_MAGIC))) {
+        // Another layout: leave it to the processes that know it
+        flock(m_fd, LOCK_UN);
+        return -1;
+    }
+
+    if (segment->ecbDate.load(std::memory_order_relaxed) >= rates.Date()) {
+        flock(m_fd, LOCK_UN);
+        return 0;
+    }
+
+    // A writer that died left the sequence odd: resume from the next even
+    uint64_t sequence = segment->sequence.load(std::memory_order_relaxed);
+    sequence += (sequence & 1);
+
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (CurrencyId id = 0; id < MAX_CURRENCIES; id++) {
+        uint64_t bits = 0;
+        if (id != CURRENCY_EUR && rates.HasRate(id)) {
+            double rate = rates.Rate(id);
+            memcpy(&bits, &rate, sizeof(bits));
+        }
+        segment->rates[id].store(bits, std::memory_order_relaxed);
+    }
+    segment->ecbDate.store(rates.Date(), std::memory_order_relaxed);
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+
+    flock(m_fd, LOCK_UN);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_SHARED_RATES_H
+#define CC_SHARED_RATES_H
+
+#include "rateSnapshot.h"
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+namespace CurrencyConverter {
+
+//
+// Rates shared by every process of a user through a POSIX shared memory
+// segment, so that processes started together don't each read the cache
+// file: the first one to get rates publishes them, the others map the
+// segment and copy them.
+//
+// The segment is a seqlock: writers, serialized by a lock on the segment,
+// make the sequence odd while they update the rates. Readers never lock:
+// they copy the rates and retry if the sequence was odd or changed
+// meanwhile. All fields are atomics, so the racing copies are well defined.
+//
+static const char SHARED_RATES_MAGIC[8] = { 'C', 'C', 'S', 'H', 'M', 'R', 'T', '\0' };
+static const uint32_t SHARED_RATES_VERSION = 1;
+
+struct SharedRatesSegment {
+	char magic[8];
+	std::atomic<uint32_t> version;		// Set once magic is, 0 before
+	uint32_t reserved;
+	std::atomic<uint64_t> sequence;		// Odd while being written
+	std::atomic<int64_t> ecbDate;		// 0 until rates are published
+	std::atomic<uint64_t> rates[MAX_CURRENCIES];	// double bits, 0: no rate
+};
+
+class SharedRateTable {
+public:
+	SharedRateTable();
+	~SharedRateTable();
+
+	// Maps the segment name, creating it if needed. Returns -1 on failure
+	int Open(const std::string &name);
+	// Copies the published rates and their date into rates, cross rates
+	// not built. Returns -1 if none were published, or a writer did not
+	// complete in time
+	int Read(RateSnapshot &rates) const;
+	// Publishes rates in place of older ones: rates dated like, or before,
+	// the published ones are not written. Returns -1 on failure
+	int Write(const RateSnapshot &rates);
+
+private:
+	SharedRateTable(const SharedRateTable &);
+	SharedRateTable& operator=(const SharedRateTable &);
+
+	int m_fd;
+	SharedRatesSegment *m_segment;
+};
+
+} // namespace CurrencyConverter
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "snapshotPublisher.h"
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace CurrencyConverter;
+
+namespace {
+
+//
+// Hazard pointers domain, shared by all publishers.
+// Each reading thread owns one record for its lifetime; records are
+// recycled when threads exit and are never freed.
+//
+// A thread may hold guards on this many publishers at once
+const size_t HAZARDS_PER_THREAD = 2;
+
+struct alignas(64) HazardRecord {
+    std::atomic<const void *> hazards[HAZARDS_PER_THREAD];
+    std::atomic<bool> active;
+    HazardRecord *next;
+    // Owner thread only: publisher and nesting level of guards of each slot
+    const SnapshotPublisher *publishers[HAZARDS_PER_THREAD];
+    unsigned depths[HAZARDS_PER_THREAD];
+};
+
+std::atomic<HazardRecord *> _hazardRecords(nullptr);
+
+HazardRecord *_acquireRecord()
+{
+    for (HazardRecord *rec = _hazardRecords.load(std::memory_order_acquire); rec; rec = rec->next) {
+        bool inactive = false;
+        if (!rec->active.load(std::memory_order_relaxed)
+            && rec->active.compare_exchange_strong(inactive, true, std::memory_order_acquire))
+            return rec;
+    }
+
+    HazardRecord *rec = new HazardRecord();
+    for (size_t i = 0; i < HAZARDS_PER_THREAD; i++) {
+        rec->hazards[i].store(nullptr, std::memory_order_relaxed);
+        rec->publishers[i] = nullptr;
+        rec->depths[i] = 0;
+    }
+    rec->active.store(true, std::memory_order_relaxed);
+
+    HazardRecord *head = _hazardRecords.load(std::memory_order_relaxed);
+    do {
+        rec->next = head;
+    } while (!_hazardRecords.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+
+    return rec;
+}
+
+struct ThreadRecord {
+    HazardRecord *rec;
+
+    ThreadRecord() : rec(_acquireRecord()) {}
+    ~ThreadRecord()
+    {
+        for (size_t i = 0; i < HAZARDS_PER_THREAD; i++) {
+            rec->hazards[i].store(nullptr, std::memory_order_release);
+            rec->publishers[i] = nullptr;
+            rec->depths[i] = 0;
+        }
+        rec->active.store(false, std::memory_order_release);
+    }
+};
+
+HazardRecord *_threadRecord()
+{
+    static thread_local ThreadRecord threadRecord;
+    return threadRecord.rec;
+}
+
+bool _isProtected(const std::vector<const void *> &hazards, const void *p)
+{
+    return std::binary_search(hazards.begin(), hazards.end(), p);
+}
+
+} // namespace
+
+SnapshotPublisher::SnapshotPublisher()
+    : m_current(nullptr)
+{
+    m_retired.reserve(MAX_FREE_SNAPSHOTS);
+    m_free.reserve(MAX_FREE_SNAPSHOTS);
+    m_hazards.reserve(HAZARDS_PER_THREAD * 16);
+}
+
+SnapshotPublisher::~SnapshotPublisher()
+{
+    // No reader may outlive the publisher
+    delete m_current.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < m_retired.size(); i++)
+        delete m_retired[i];
+    for (size_t i = 0; i < m_free.size(); i++)
+        delete m_free[i];
+}
+
+RateSnapshot *SnapshotPublisher::Acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_publishLock);
+        if (!m_free.empty()) {
+            RateSnapshot *snapshot = m_free.back();
+            m_free.pop_back();
+            snapshot->Clear();
+            return snapshot;
+        }
+    }
+    return new RateSnapshot();
+}
+
+void SnapshotPublisher::Publish(RateSnapshot *snapshot)
+{
+    std::lock_guard<std::mutex> lock(m_publishLock);
+
+    // Published snapshots are only read through guards, but they still
+    // belong to the publisher, which gets them back writable
+    RateSnapshot *previous = const_cast<RateSnapshot *>(m_current.exchange(snapshot, std::memory_order_seq_cst));
+    if (previous)
+        m_retired.push_back(previous);
+
+    reclaim();
+}
+
+void SnapshotPublisher::reclaim()
+{
+    m_hazards.clear();
+    for (HazardRecord *rec = _hazardRecords.load(std::memory_order_acquire); rec; rec = rec->next) {
+        for (size_t i = 0; i < HAZARDS_PER_THREAD; i++) {
+            const void *hazard = rec->hazards[i].load(std::memory_order_seq_cst);
+            if (hazard)
+                m_hazards.push_back(hazard);
+        }
+    }
+    std::sort(m_hazards.begin(), m_hazards.end());
+
+    // Snapshots still referenced by a reader are retried on next Publish()
+    size_t kept = 0;
+    for (size_t i = 0; i < m_retired.size(); i++) {
+        if (_isProtected(m_hazards, m_retired[i]))
+            m_retired[kept++] = m_retired[i];
+        else if (m_free.size() < MAX_FREE_SNAPSHOTS)
+            m_free.push_back(m_retired[i]);
+        else
+            delete m_retired[i];
+    }
+    m_retired.resize(kept);
+}
+
+SnapshotGuard::SnapshotGuard(const SnapshotPublisher &publisher)
+{
+    HazardRecord *rec = _threadRecord();
+
+    // Nested guard on the same publisher: share the outer guard snapshot
+    size_t slot = HAZARDS_PER_THREAD;
+    for (size_t i = 0; i < HAZARDS_PER_THREAD; i++) {
+        if (rec->depths[i] > 0 && rec->publishers[i] == &publisher) {
+            rec->depths[i]++;
+            m_slot = i;
+            m_snapshot = (const RateSnapshot *) rec->hazards[i].load(std::memory_order_relaxed);
+            return;
+        }
+        if (rec->depths[i] == 0 && slot == HAZARDS_PER_THREAD)
+            slot = i;
+    }
+
+    if (slot == HAZARDS_PER_THREAD)
+        abort();
+
+    // Protect the pointer, then check it is still the current one: if so,
+    // Publish() can't have missed our hazard when scanning
+    const RateSnapshot *snapshot = publisher.m_current.load(std::memory_order_acquire);
+    for (;;) {
+        rec->hazards[slot].store(snapshot, std::memory_order_seq_cst);
+        const RateSnapshot *current = publisher.m_current.load(std::memory_order_seq_cst);
+        if (current == snapshot)
+            break;
+        snapshot = current;
+    }
+
+    rec->publishers[slot] = &publisher;
+    rec->depths[slot] = 1;
+    m_slot = slot;
+    m_snapshot = snapshot;
+}
+
+SnapshotGuard::~SnapshotGuard()
+{
+    HazardRecord *rec = _threadRecord();
+
+    if (--rec->depths[m_slot] == 0) {
+        rec->hazards[m_slot].store(nullptr, std::memory_order_release);
+        rec->publishers[m_slot] = nullptr;
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_SNAPSHOT_PUBLISHER_H
+#define CC_SNAPSHOT_PUBLISHER_H
+
+#include "rateSnapshot.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace CurrencyConverter {
+
+//
+// Publishes immutable rate snapshots to concurrent readers.
+//
+// Readers never lock: a SnapshotGuard reads the current snapshot pointer
+// and protects it with a per thread hazard pointer, which costs a couple
+// of atomic operations on a cache line owned by the reading thread.
+// Publish() swaps the pointer atomically and frees the previous snapshot
+// as soon as no hazard pointer references it anymore.
+//
+// Freed snapshots are kept for reuse: rates are parsed or loaded straight
+// into a snapshot from Acquire(), a flat block of arrays, so the steady
+// state refresh (parse, build cross rates, publish) does not allocate.
+//
+class SnapshotPublisher {
+public:
+	SnapshotPublisher();
+	~SnapshotPublisher();
+
+	// A cleared snapshot, owned by the caller until given to Publish(),
+	// or deleted. Recycles a freed one when available.
+	RateSnapshot *Acquire();
+
+	// Makes snapshot (from Acquire() or allocated with new) the current one
+	// and takes its ownership. Concurrent Publish() calls are serialized.
+	void Publish(RateSnapshot *snapshot);
+
+private:
+	// Freed snapshots kept for Acquire(): one being filled, one retired
+	// and a spare for a reader still holding an older one
+	static const size_t MAX_FREE_SNAPSHOTS = 3;
+
+	SnapshotPublisher(const SnapshotPublisher &);
+	SnapshotPublisher& operator=(const SnapshotPublisher &);
+	friend class SnapshotGuard;
+
+	void reclaim();
+
+	std::atomic<const RateSnapshot *> m_current;
+	std::mutex m_publishLock;
+	// Under m_publishLock. Capacity is reserved: reclaiming doesn't allocate
+	std::vector<RateSnapshot *> m_retired;
+	std::vector<RateSnapshot *> m_free;
+	std::vector<const void *> m_hazards;
+};
+
+//
+// Read access to the current snapshot for the guard lifetime.
+// Guards nested in the same thread share the snapshot of the outermost one,
+// so a thread always sees a consistent set of rates. A thread may hold
+// guards on two different publishers at a time.
+//
+class SnapshotGuard {
+public:
+	explicit SnapshotGuard(const SnapshotPublisher &publisher);
+	~SnapshotGuard();
+
+	// NULL if nothing was published yet
+	const RateSnapshot *Get() const { return m_snapshot; }
+	const RateSnapshot *operator->() const { return m_snapshot; }
+
+private:
+	SnapshotGuard(const SnapshotGuard &);
+	SnapshotGuard& operator=(const SnapshotGuard &);
+
+	const RateSnapshot *m_snapshot;
+	size_t m_slot;
+};
+
+} // namespace CurrencyConverter
+
+#endif
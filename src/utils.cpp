@@ -18,8 +18,16 @@
  */
 
 #include "utils.h"
+#include "ecbCalendar.h"
+#include <cerrno>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static const char *XDG_LOCAL_DIR = "/.local/share";
 std::string _getLocalDir()
@@ -53,6 +61,159 @@ std::string _getStorageFileName()
     return storageFn;
 }
 
+static const char *LOCAL_RATE_CACHE_FN = "currency_converter.rates";
+std::string _getRateCacheFileName()
+{
+	std::string rateCacheFn = _getLocalDir();
+	rateCacheFn += LOCAL_RATE_CACHE_FN;
+
+	return rateCacheFn;
+}
+
+static const char *LOCAL_HISTORY_FN = "currency_converter.hist";
+std::string _getHistoryFileName()
+{
+	std::string historyFn = _getLocalDir();
+	historyFn += LOCAL_HISTORY_FN;
+
+	return historyFn;
+}
+
+static const char *LOCAL_SOCKET_FN = "currency_converter.sock";
+std::string _getSocketFileName()
+{
+	std::string socketFn = _getLocalDir();
+	socketFn += LOCAL_SOCKET_FN;
+
+	return socketFn;
+}
+
+static const char *LOCAL_METRICS_FN = "currency_converter.prom";
+std::string _getMetricsFileName()
+{
+	std::string metricsFn = _getLocalDir();
+	metricsFn += LOCAL_METRICS_FN;
+
+	return metricsFn;
+}
+
+static const char *LOCAL_VALIDATORS_FN = "currency_converter.validators";
+std::string _getValidatorsFileName()
+{
+	std::string validatorsFn = _getLocalDir();
+	validatorsFn += LOCAL_VALIDATORS_FN;
+
+	return validatorsFn;
+}
+
+// One shared memory segment per rates cache: named after the user and the
+// cache directory, which shm names can't hold
+static const char *SHARED_RATES_PREFIX = "/currency_converter.";
+std::string _getSharedRatesName()
+{
+	std::string localDir = _getLocalDir();
+	uint32_t hash = 2166136261u;	// 32 bits FNV-1a
+	for (size_t i = 0; i < localDir.size(); i++) {
+		hash ^= (unsigned char) localDir[i];
+		hash *= 16777619u;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s%u.%08x", SHARED_RATES_PREFIX, (unsigned) getuid(), hash);
+	return name;
+}
+
+static const char *LOCAL_ARCHIVE_FN = "currency_converter.archive";
+std::string _getArchiveFileName()
+{
+	std::string archiveFn = _getLocalDir();
+	archiveFn += LOCAL_ARCHIVE_FN;
+
+	return archiveFn;
+}
+
+// Held by the process downloading rates (see RateManager::refreshRates)
+static const char *LOCAL_REFRESH_LEASE_FN = "currency_converter.lock";
+std::string _getRefreshLeaseFileName()
+{
+	std::string leaseFn = _getLocalDir();
+	leaseFn += LOCAL_REFRESH_LEASE_FN;
+
+	return leaseFn;
+}
+
+int _createTempFile(const std::string &fileName, std::string &tmpFileName)
+{
+	// Unique per writer: concurrent writers never share a temporary file
+	tmpFileName = fileName + ".XXXXXX";
+	int fd = mkstemp(&tmpFileName[0]);
+	if (fd < 0)
+		return -1;
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fchmod(fd, 0644);
+	return fd;
+}
+
+int _commitTempFile(int fd, const std::string &tmpFileName, const std::string &fileName, bool ok)
+{
+	// Data must be on disk before the rename is: a crash in between would
+	// otherwise leave an empty file in place of the previous one
+	ok = ok && fsync(fd) == 0;
+	ok = (close(fd) == 0) && ok;
+
+	if (!ok || rename(tmpFileName.c_str(), fileName.c_str()) < 0) {
+		unlink(tmpFileName.c_str());
+		return -1;
+	}
+
+	return 0;
+}
+
+int _writeFileAtomically(const std::string &fileName, const std::function<void(FILE *)> &write)
+{
+	std::string tmpFileName;
+	int fd = _createTempFile(fileName, tmpFileName);
+	if (fd < 0)
+		return -1;
+
+	// Written through a stream on a duplicate: fd stays open to be committed
+	int streamFd = dup(fd);
+	FILE *out = (streamFd < 0) ? NULL : fdopen(streamFd, "w");
+	if (!out) {
+		if (streamFd >= 0)
+			close(streamFd);
+		return _commitTempFile(fd, tmpFileName, fileName, false);
+	}
+
+	write(out);
+	bool ok = !ferror(out);
+	ok = (fclose(out) == 0) && ok;
+
+	return _commitTempFile(fd, tmpFileName, fileName, ok);
+}
+
+static const unsigned LOCK_POLL_MS = 20;
+int _lockFile(const std::string &fileName, unsigned waitMs, bool *contended)
+{
+	*contended = false;
+	int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+
+	// flock has no timeout: poll
+	for (unsigned waitedMs = 0; flock(fd, LOCK_EX | LOCK_NB) < 0; waitedMs += LOCK_POLL_MS) {
+		if (errno != EWOULDBLOCK || waitedMs >= waitMs) {
+			close(fd);
+			return -1;
+		}
+		*contended = true;
+		usleep(LOCK_POLL_MS * 1000);
+	}
+
+	return fd;
+}
+
 static const char *LOCAL_LAST_UPDATED_FN = "currency_converter.last_updated";
 std::string _getLastUpdatedFileName()
 {
@@ -62,15 +223,11 @@ std::string _getLastUpdatedFileName()
 	return lastUpdatedFn;
 }
 
-#define ECB_RATES_UPDATE_TIME_UTC_HOUR		15
-#define ECB_RATES_UPDATE_TIME_UTC_MIN		30
-#define ECB_RATES_UPDATE_TIME_UTC_SEC		0
-#define NUM_SECONDS_DAY						86400
-
 time_t ecbDateToTime(const char *ecbDate)
 {
 	// ECB date format is: YYYY-MM-DD
 	struct tm tmDate;
+	memset(&tmDate, 0, sizeof(tmDate));
 
 	std::string sdate = ecbDate;
 	tmDate.tm_year = std::atoi ( sdate.substr(0,4).c_str() );
@@ -79,21 +236,63 @@ time_t ecbDateToTime(const char *ecbDate)
 	tmDate.tm_mon -= 1;
 	tmDate.tm_mday = std::atoi ( sdate.substr(8,2).c_str() );
 
-	tmDate.tm_hour = ECB_RATES_UPDATE_TIME_UTC_HOUR;
-	tmDate.tm_min = ECB_RATES_UPDATE_TIME_UTC_MIN;
-	tmDate.tm_sec = ECB_RATES_UPDATE_TIME_UTC_SEC;
+	tmDate.tm_hour = CurrencyConverter::ECB_PUBLICATION_POLICY.hour;
+	tmDate.tm_min = CurrencyConverter::ECB_PUBLICATION_POLICY.minute;
+	tmDate.tm_sec = CurrencyConverter::ECB_PUBLICATION_POLICY.second;
 
-	return mktime ( &tmDate );
+	// Broken down time is UTC: don't let the local time zone shift it
+	return timegm ( &tmDate );
 }
 
-static bool after_ecb_update_time_limit (const struct tm *now)
+int civilToDay(int year, int month, int mday)
 {
-	if ((now->tm_hour > ECB_RATES_UPDATE_TIME_UTC_HOUR) ||
-		((now->tm_hour == ECB_RATES_UPDATE_TIME_UTC_HOUR) && (now->tm_min > ECB_RATES_UPDATE_TIME_UTC_MIN)) ) {
-		return true;
-	}
+	return CurrencyConverter::CivilToDay(year, month, mday);
+}
+
+void dayToCivil(int day, int *year, int *month, int *mday)
+{
+	day += 719468;
+	const int era = (day >= 0 ? day : day - 146096) / 146097;
+	const int doe = day - era * 146097;
+	const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const int mp = (5 * doy + 2) / 153;
+
+	*mday = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp + (mp < 10 ? 3 : -9);
+	*year = yoe + era * 400 + (*month <= 2);
+}
+
+int ecbDateToDay(const char *ecbDate)
+{
+	// ECB date format is: YYYY-MM-DD
+	int year, month, mday;
+	char end;
 
-	return false;
+	if (sscanf(ecbDate, "%4d-%2d-%2d%c", &year, &month, &mday, &end) != 3)
+		return -1;
+	if (month < 1 || month > 12 || mday < 1 || mday > 31)
+		return -1;
+
+	return civilToDay(year, month, mday);
+}
+
+void dayToEcbDate(int day, char *ecbDate)
+{
+	int year, month, mday;
+
+	dayToCivil(day, &year, &month, &mday);
+	ecbDate[0] = '0' + (year / 1000) % 10;
+	ecbDate[1] = '0' + (year / 100) % 10;
+	ecbDate[2] = '0' + (year / 10) % 10;
+	ecbDate[3] = '0' + year % 10;
+	ecbDate[4] = '-';
+	ecbDate[5] = '0' + month / 10;
+	ecbDate[6] = '0' + month % 10;
+	ecbDate[7] = '-';
+	ecbDate[8] = '0' + mday / 10;
+	ecbDate[9] = '0' + mday % 10;
+	ecbDate[10] = '\0';
 }
 
 time_t getEcbLastUpdateTime()
@@ -102,65 +301,15 @@ time_t getEcbLastUpdateTime()
 	// From "https://www.ecb.europa.eu/stats/policy_and_exchange_rates/euro_reference_exchange_rates/html/index.en.html"
 	// The reference rates are usually updated around 16:00 CET on every working day,
 	// except on TARGET closing days
-	// This means that reference rates are updated Monday to Friday around 15:00 UTC
-	// Our implementation gives time to the ECB to update the rates, so our reference
-	// update time will be a bit later than 15:00 UTC
-	// Note that our implementation DOES NOT take TARGET closing days into account
-	// This is a limitation.
-
-	// Here, implementation computes the last update date and time from the current UTC time
-
-	// Get current UTC time
-	time_t utcNow_;
-	time ( &utcNow_ );
-	struct tm * utcNow = gmtime ( &utcNow_ );
-
-	// Now, find what was the last day rate were updated
-	// If current UTC time is before time limit, rates were updated yesterday or
-	// last friday otherwise, they were updated today
-	int num_of_days_to_rewind_to = 0;
-
-	// Get last update day
-	switch (utcNow->tm_wday) {
-		case 0: // sunday
-			// last update was on friday, so 2 days ago
-			num_of_days_to_rewind_to = 2;
-			break;
-		case 1: // monday
-			if (after_ecb_update_time_limit(utcNow)) {
-				// Current UTC time is after update time limit:
-				// rates were updated today
-				num_of_days_to_rewind_to = 0;
-			} else {
-				// Current UTC time is before update time limit:
-				// last update was on friday, so 3 days ago.
-				num_of_days_to_rewind_to = 3;
-			}
-			break;
-		case 2: // tuesday
-		case 3: // wednesday
-		case 4: // thursday
-		case 5: // friday
-			if (after_ecb_update_time_limit(utcNow)) {
-				// Current UTC time is after update time limit:
-				// rates were updated today
-				num_of_days_to_rewind_to = 0;
-			}
-			else {
-				// Current UTC time is before update time limit:
-				// last update was yesterday
-				num_of_days_to_rewind_to = 1;
-			}
-			break;
-		case 6: // saturday
-			// last update was on friday, so yesterday
-			num_of_days_to_rewind_to = 1;
-			break;
-	}
-	utcNow->tm_hour = ECB_RATES_UPDATE_TIME_UTC_HOUR;
-	utcNow->tm_min = ECB_RATES_UPDATE_TIME_UTC_MIN;
-	utcNow->tm_sec = ECB_RATES_UPDATE_TIME_UTC_SEC;
+	// Rates of a day are expected a bit later (see ECB_PUBLICATION_POLICY), and
+	// closing days come from the TARGET calendar: on holidays, the rates of the
+	// previous working day are the latest ones, and are not fetched again
+	//
+	return CurrencyConverter::LastPublicationTime(time(NULL));
+}
 
-	time_t ecbRatesLastUpdatedTime = mktime ( utcNow ) - (num_of_days_to_rewind_to*NUM_SECONDS_DAY);
-	return ecbRatesLastUpdatedTime;
+time_t getEcbNextUpdateTime()
+{
+	// Next working day after the last update, same time of day
+	return CurrencyConverter::NextPublicationTime(time(NULL));
 }
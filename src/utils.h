@@ -21,14 +21,47 @@
 #define CC_UTILS_H
 
 #include "rateManager.h"
-#include <libxml/xmlreader.h>
-#include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <cstdio>
 #include <fstream>
+#include <functional>
 
+std::string _getRateCacheFileName();
+std::string _getHistoryFileName();
+std::string _getSocketFileName();
+std::string _getMetricsFileName();
+std::string _getValidatorsFileName();
+std::string _getSharedRatesName();
 std::string _getStorageFileName();
 std::string _getLastUpdatedFileName();
+std::string _getArchiveFileName();
+std::string _getRefreshLeaseFileName();
+#define NUM_SECONDS_DAY	86400
+
 time_t ecbDateToTime(const char *date);
+
+// Dates as day numbers: days elapsed since 1970-01-01
+#define ECB_DATE_LEN	10	// "YYYY-MM-DD"
+int civilToDay(int year, int month, int mday);
+void dayToCivil(int day, int *year, int *month, int *mday);
+int ecbDateToDay(const char *date);
+void dayToEcbDate(int day, char *date);
 time_t getEcbLastUpdateTime();
+time_t getEcbNextUpdateTime();
+
+// Atomic file replacement: data goes to a temporary file next to fileName,
+// which is flushed to disk then renamed over it, so readers get the whole
+// previous or the whole new file. _createTempFile returns its descriptor,
+// or -1. _commitTempFile closes it and, if ok, renames it; otherwise, or if
+// that fails, removes it. Returns 0 once fileName is replaced, -1 otherwise
+int _createTempFile(const std::string &fileName, std::string &tmpFileName);
+int _commitTempFile(int fd, const std::string &tmpFileName, const std::string &fileName, bool ok);
+// Replaces fileName with what write prints to the stream it is given
+int _writeFileAtomically(const std::string &fileName, const std::function<void(FILE *)> &write);
+
+// Exclusive lock on fileName (created if needed), held until the returned
+// descriptor is closed, or the process exits. Waits up to waitMs for
+// another holder; *contended tells whether there was one. Returns -1 on
+// timeout or error
+int _lockFile(const std::string &fileName, unsigned waitMs, bool *contended);
 
 #endif
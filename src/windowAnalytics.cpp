@@ -0,0 +1,197 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *  This file is part of CurrencyConverter.
+ *
+ *  CurrencyConverter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  CurrencyConverter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "windowAnalytics.h"
+#include "convertKernels.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace CurrencyConverter;
+
+WindowAnalytics::WindowAnalytics(const RateHistory &history) :
+    m_history(history)
+{
+}
+
+const double *WindowAnalytics::column(CurrencyId id)
+{
+    if (id != CURRENCY_EUR)
+        return m_history.Column(id);
+
+    m_eurColumn.assign(m_history.NumDays(), 1.0);
+    return m_eurColumn.data();
+}
+
+const double *WindowAnalytics::logColumn(CurrencyId id)
+{
+    if (id == CURRENCY_EUR) {
+        m_eurLogColumn.assign(m_history.NumDays(), 0.0);
+        return m_eurLogColumn.data();
+    }
+
+    std::vector<double> &logs = m_logColumns[id];
+    if (logs.size() != m_history.NumDays()) {
+        const double *rates = m_history.Column(id);
+        logs.resize(m_history.NumDays());
+        for (size_t i = 0; i < logs.size(); i++)
+            logs[i] = log(rates[i]);
+    }
+    return logs.data();
+}
+
+// prefix[0] = 0, prefix[i + 1] = values[0] + ... + values[i]
+static void _prefixSums(const double *values, size_t count, std::vector<double> &prefix)
+{
+    prefix.resize(count + 1);
+    double sum = 0;
+    prefix[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += values[i];
+        prefix[i + 1] = sum;
+    }
+}
+
+// out[i] = maximum (or minimum) of values[i .. i + window - 1], for the
+// count - window + 1 windows. In blocks of window elements, running
+// extremes from the block start (forward) and to the block end (backward):
+// a window spans at most two blocks, and its extreme is the backward one
+// at its start combined with the forward one at its end
+template <bool MAX>
+static void _windowExtremes(const double *values, size_t count, size_t window,
+    std::vector<double> &blocks, double *out)
+{
+    blocks.resize(2 * count);
+    double *forward = blocks.data();
+    double *backward = forward + count;
+
+    for (size_t i = 0; i < count; i++) {
+        forward[i] = (i % window == 0) ? values[i] :
+            (MAX ? std::max(forward[i - 1], values[i]) : std::min(forward[i - 1], values[i]));
+    }
+    for (size_t i = count; i-- > 0; ) {
+        backward[i] = (i == count - 1 || (i + 1) % window == 0) ? values[i] :
+            (MAX ? std::max(backward[i + 1], values[i]) : std::min(backward[i + 1], values[i]));
+    }
+
+    if (MAX)
+        Kernels::Maximum(backward, forward + window - 1, out, count - window + 1);
+    else
+        Kernels::Minimum(backward, forward + window - 1, out, count - window + 1);
+}
+
+int WindowAnalytics::Compute(CurrencyId base, CurrencyId quote, int fromDay, int toDay, size_t window, WindowStats &stats)
+{
+    // Cleared rather than replaced: repeated queries reuse the buffers
+    stats.days.clear();
+    stats.rates.clear();
+    stats.means.clear();
+    stats.minimums.clear();
+    stats.maximums.clear();
+    stats.volatilities.clear();
+
+    const double *baseRates = column(base);
+    const double *quoteRates = column(quote);
+    if (!baseRates || !quoteRates || window < 3)
+        return -1;
+
+    const int32_t *days = m_history.Days();
+    size_t numDays = m_history.NumDays();
+    size_t end = std::upper_bound(days, days + numDays, toDay) - days;
+    size_t begin = std::lower_bound(days, days + numDays, fromDay) - days;
+    if (begin >= end)
+        return 0;
+
+    // Go back far enough for the first day to have a full window
+    for (size_t found = 0; begin > 0 && found + 1 < window; ) {
+        begin--;
+        if (!isnan(baseRates[begin]) && !isnan(quoteRates[begin]))
+            found++;
+    }
+
+    // Pair series, and its logs: differences of the EUR based logs
+    size_t n = end - begin;
+    m_rates.resize(n);
+    m_logs.resize(n);
+    Kernels::Divide(quoteRates + begin, baseRates + begin, m_rates.data(), n);
+    Kernels::Subtract(logColumn(quote) + begin, logColumn(base) + begin, m_logs.data(), n);
+
+    // Leave out the days without rates, in place
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (isnan(m_rates[i]))
+            continue;
+        stats.days.push_back(days[begin + i]);
+        m_rates[count] = m_rates[i];
+        m_logs[count] = m_logs[i];
+        count++;
+    }
+    if (count < window) {
+        stats.days.clear();
+        return 0;
+    }
+
+    // Window i spans elements i .. i + window - 1, and ends on day i + window - 1
+    size_t numWindows = count - window + 1;
+    stats.rates.assign(m_rates.begin() + window - 1, m_rates.begin() + count);
+    stats.days.erase(stats.days.begin(), stats.days.begin() + window - 1);
+
+    stats.means.resize(numWindows);
+    _prefixSums(m_rates.data(), count, m_prefix);
+    Kernels::WindowSums(m_prefix.data(), window, 1.0 / window, stats.means.data(), numWindows);
+
+    stats.minimums.resize(numWindows);
+    stats.maximums.resize(numWindows);
+    _windowExtremes<false>(m_rates.data(), count, window, m_blocks, stats.minimums.data());
+    _windowExtremes<true>(m_rates.data(), count, window, m_blocks, stats.maximums.data());
+
+    // Sample variance of the window - 1 log returns of each window:
+    // (mean of squares - squared mean) * n / (n - 1)
+    size_t numReturns = window - 1;
+    std::vector<double> &returns = m_rates;     // Rates are not needed anymore
+    Kernels::Subtract(m_logs.data() + 1, m_logs.data(), returns.data(), count - 1);
+
+    m_meanReturns.resize(numWindows);
+    _prefixSums(returns.data(), count - 1, m_prefix);
+    Kernels::WindowSums(m_prefix.data(), numReturns, 1.0 / numReturns, m_meanReturns.data(), numWindows);
+
+    for (size_t i = 0; i < count - 1; i++)
+        returns[i] *= returns[i];
+    stats.volatilities.resize(numWindows);
+    _prefixSums(returns.data(), count - 1, m_prefix);
+    Kernels::WindowSums(m_prefix.data(), numReturns, 1.0 / numReturns, stats.volatilities.data(), numWindows);
+
+    double scale = (double) numReturns / (numReturns - 1) * TRADING_DAYS;
+    for (size_t i = 0; i < numWindows; i++) {
+        double variance = (stats.volatilities[i] - m_meanReturns[i] * m_meanReturns[i]) * scale;
+        stats.volatilities[i] = sqrt(std::max(variance, 0.0));
+    }
+
+    // Windows ending before fromDay only served as look back
+    size_t first = std::lower_bound(stats.days.begin(), stats.days.end(), fromDay) - stats.days.begin();
+    if (first > 0) {
+        stats.days.erase(stats.days.begin(), stats.days.begin() + first);
+        stats.rates.erase(stats.rates.begin(), stats.rates.begin() + first);
+        stats.means.erase(stats.means.begin(), stats.means.begin() + first);
+        stats.minimums.erase(stats.minimums.begin(), stats.minimums.begin() + first);
+        stats.maximums.erase(stats.maximums.begin(), stats.maximums.begin() + first);
+        stats.volatilities.erase(stats.volatilities.begin(), stats.volatilities.begin() + first);
+    }
+
+    return 0;
+}
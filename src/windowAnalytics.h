@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2019 Gilles Talis
+ *
+ *	This file is part of CurrencyConverter.
+ *
+ *	CurrencyConverter is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	CurrencyConverter is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC_WINDOW_ANALYTICS_H
+#define CC_WINDOW_ANALYTICS_H
+
+#include "rateHistory.h"
+#include <stdint.h>
+#include <vector>
+
+namespace CurrencyConverter {
+
+// Rolling statistics of a currency pair, one element per business day,
+// in the columns of the history
+struct WindowStats {
+	std::vector<int32_t> days;
+	std::vector<double> rates;		// Quote currency units per base unit
+	std::vector<double> means;
+	std::vector<double> minimums;
+	std::vector<double> maximums;
+	std::vector<double> volatilities;	// Annualized stddev of daily log returns
+};
+
+//
+// Sliding window statistics over the history columns. Any pair is derived
+// on the fly from the two EUR based columns, with the days either one is
+// missing left out. Every statistic is computed in O(n) whatever the
+// window: means and variances from prefix sums, minimums and maximums with
+// the van Herk / Gil-Werman block algorithm; the element wise passes are
+// SIMD kernels.
+//
+// Log rates of each currency are computed on first use and kept: create one
+// instance per history to query many pairs. Not thread safe.
+//
+class WindowAnalytics {
+public:
+	// Business days in a year, to annualize volatilities
+	static const int TRADING_DAYS = 252;
+
+	explicit WindowAnalytics(const RateHistory &history);
+
+	// Statistics over windows of `window` business days, for each business
+	// day of [fromDay, toDay] with a full window: windows may start before
+	// fromDay. Returns -1 if a currency was never published or window < 3
+	int Compute(CurrencyId base, CurrencyId quote, int fromDay, int toDay, size_t window, WindowStats &stats);
+
+private:
+	const double *column(CurrencyId id);
+	const double *logColumn(CurrencyId id);
+
+	const RateHistory &m_history;
+	std::vector<double> m_eurColumn;	// EUR rates (1), and logs (0)
+	std::vector<double> m_eurLogColumn;
+	std::vector<double> m_logColumns[MAX_CURRENCIES];
+	// Scratch buffers, reused across queries
+	std::vector<double> m_rates;
+	std::vector<double> m_logs;
+	std::vector<double> m_prefix;
+	std::vector<double> m_meanReturns;
+	std::vector<double> m_blocks;
+};
+
+} // namespace CurrencyConverter
+
+#endif